@@ -1,13 +1,153 @@
+#include <algorithm>
+#include <array>
 #include <random>
 #include <cassert>
 #include <fmt/format.h>
 #include <valarray>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <numeric>
+#include <limits>
+#include <cmath>
+#include <memory>
+#include <cstring>
+#include <string_view>
+#include <new>
+#include <csignal>
+#include <sched.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
-std::default_random_engine randomEngine {std::random_device()()};
+// Keyed generator: the Key is hashed by the counter-based Philox4x32-10 into the 128-bit state of a xoshiro128++
+// generator, which then produces the stream. Every random stream is addressed by a Key, so a world, a child genome
+// or a simulation can be regenerated on demand, and results do not depend on which thread drew the numbers, while
+// drawing costs a few shifts and adds per number. Satisfies UniformRandomBitGenerator, so it can also drive the
+// standard distributions, but the hot paths use the bounded helpers below.
+struct RandomEngine
+{
+  enum struct Stream : uint32_t {
+    INITIAL,
+    BREED,
+    WORLD,
+    SIMULATE,
+    MUTATE,
+  };
+  struct Key {
+    uint64_t seed;
+    uint32_t generation;
+    uint32_t individual;
+    Stream stream;
+    uint32_t world = 0;
+  };
+  using result_type = uint32_t;
+
+  RandomEngine(const Key& key)
+  {
+    uint32_t philoxKey[2] = {static_cast<uint32_t>(key.seed), static_cast<uint32_t>(key.seed >> 32)};
+    uint32_t counter[4] = {0, key.individual, key.generation, static_cast<uint32_t>(key.stream) | (key.world << 8)};
+    philox(philoxKey, counter, state);
+    state[0] |= (state[0] | state[1] | state[2] | state[3]) == 0; // the all-zero state is a fixed point
+  }
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return ~result_type{0}; }
+
+  result_type operator()()
+  {
+    uint32_t result = rotl(state[0] + state[3], 7) + state[0];
+    uint32_t t = state[1] << 9;
+    state[2] ^= state[0];
+    state[3] ^= state[1];
+    state[1] ^= state[2];
+    state[0] ^= state[3];
+    state[2] ^= t;
+    state[3] = rotl(state[3], 11);
+    return result;
+  }
+
+  // Same numbers as `count` calls of operator().
+  void generate(result_type* out, int count)
+  {
+    for (int i = 0; i < count; ++i) {
+      out[i] = (*this)();
+    }
+  }
+
+  // Uniform integer in [0, range): Lemire's multiply-shift, which only needs a division (and a redraw) in the rare
+  // case that the low half of the product falls into the biased region.
+  uint32_t below(uint32_t range)
+  {
+    uint64_t product = static_cast<uint64_t>((*this)()) * range;
+    if (static_cast<uint32_t>(product) < range) {
+      uint32_t threshold = -range % range;
+      while (static_cast<uint32_t>(product) < threshold) {
+        product = static_cast<uint64_t>((*this)()) * range;
+      }
+    }
+    return static_cast<uint32_t>(product >> 32);
+  }
+
+  uint64_t next64()
+  {
+    uint64_t hi = (*this)();
+    return hi << 32 | (*this)();
+  }
+
+  // Uniform float in [0, 1) with 24 random bits, and double with 53.
+  float uniform() { return ((*this)() >> 8) * 0x1p-24f; }
+  double uniform53() { return (next64() >> 11) * 0x1p-53; }
+
+private:
+  static constexpr int ROUNDS = 10;
+  uint32_t state[4];
+
+  static uint32_t rotl(uint32_t x, int k)
+  {
+    return (x << k) | (x >> (32 - k));
+  }
+
+  static void mulhilo(uint32_t a, uint32_t b, uint32_t& hi, uint32_t& lo)
+  {
+    uint64_t product = static_cast<uint64_t>(a) * b;
+    hi = static_cast<uint32_t>(product >> 32);
+    lo = static_cast<uint32_t>(product);
+  }
+
+  static void philox(const uint32_t key[2], const uint32_t counter[4], uint32_t out[4])
+  {
+    uint32_t k0 = key[0], k1 = key[1];
+    uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+    for (int r = 0; r < ROUNDS; ++r) {
+      uint32_t hi0, lo0, hi1, lo1;
+      mulhilo(0xD2511F53, c0, hi0, lo0);
+      mulhilo(0xCD9E8D57, c2, hi1, lo1);
+      c0 = hi1 ^ c1 ^ k0;
+      c1 = lo1;
+      c2 = hi0 ^ c3 ^ k1;
+      c3 = lo0;
+      k0 += 0x9E3779B9;
+      k1 += 0xBB67AE85;
+    }
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+  }
+};
 
 constexpr float PICK_SUCCESS_PTS = 10;
 constexpr float PICK_FAIL_PTS = -1;
 constexpr float WALL_HIT_PTS = -5;
+constexpr int POPULATION_SIZE = 10000;
 
 struct Input {
   enum struct State : int8_t {
@@ -65,17 +205,21 @@ private:
   }
 };
 
-struct World
+// Grid dimensions and the step budget of a run are template parameters, so that loops over cells, neighbourhood
+// tables and step counts are constants. `World` is the classic 11x11 grid; other sizes are picked in main.
+template <int Width, int Height, int MaxSteps = Width * Height>
+struct BasicWorld
 {
-  static constexpr int WIDTH = 11;
-  static constexpr int HEIGHT = 11;
+  static constexpr int WIDTH = Width;
+  static constexpr int HEIGHT = Height;
+  static constexpr int MAX_STEPS = MaxSteps;
   static constexpr float FILL = 0.2;
   bool hasCan[HEIGHT][WIDTH] = {false};
   int canCount = {0};
 
   // struct ArgsCreateRandom {};
 
-  World(float fill)
+  BasicWorld(float fill, RandomEngine& randomEngine)
   {
     std::uniform_real_distribution<float> uniformRealDistribution;
     for (int y = 0; y < HEIGHT; ++y) {
@@ -120,6 +264,11 @@ struct World
     };
   }
 
+  int getInputCode(int x, int y)
+  {
+    return static_cast<int>(getInput(x, y));
+  }
+
   std::string toString()
   {
     std::string repr;
@@ -135,10 +284,264 @@ struct World
 
   bool isCoordinateValid(int x, int y)
   {
-    return (0 <= x && x < World::WIDTH) && (0 <= y && y < World::HEIGHT);
+    return (0 <= x && x < WIDTH) && (0 <= y && y < HEIGHT);
+  }
+};
+
+using World = BasicWorld<11, 11>;
+
+// Same world as above, but cans are packed into a bitboard of 64-bit words (bit index = y * WIDTH + x).
+// Cells outside of the grid are mapped onto a spare bit which is never set, so building an input code
+// is a fixed sequence of shifts and masks, without any range checks.
+template <int Width, int Height, int MaxSteps = Width * Height>
+struct BasicBitWorld
+{
+  using Word = uint64_t;
+  static constexpr int WIDTH = Width;
+  static constexpr int HEIGHT = Height;
+  static constexpr int CELLS = WIDTH * HEIGHT;
+  static constexpr int MAX_STEPS = MaxSteps;
+  static constexpr float FILL = BasicWorld<Width, Height>::FILL;
+  static constexpr int WALL_BIT = CELLS;
+  static constexpr int WORDS = (WALL_BIT + 1 + 63) / 64;
+  using Board = std::array<Word, WORDS>;
+  // Input code contribution of a can in the current, north, east, south and west cell.
+  static constexpr int CAN_CODE[Input::LENGTH] = {
+    static_cast<int>(Input::State::CAN) * 81,
+    static_cast<int>(Input::State::CAN) * 27,
+    static_cast<int>(Input::State::CAN) * 9,
+    static_cast<int>(Input::State::CAN) * 3,
+    static_cast<int>(Input::State::CAN) * 1,
+  };
+
+  struct Neighbourhood {
+    uint16_t bit[Input::LENGTH]; // current, north, east, south, west
+    int16_t wallCode;            // input code contribution of the walls around the cell
+  };
+
+  Board cans = {0};
+  int canCount = {0};
+
+  BasicBitWorld() = default;
+
+  // A cell gets a can if its 32-bit random word is below fill in 0.32 fixed point, which is what comparing
+  // uniform_real_distribution<float> against fill amounts to (up to float rounding). The comparisons of 64 cells
+  // form one board word.
+  BasicBitWorld(float fill, RandomEngine& randomEngine)
+  {
+    const auto threshold = static_cast<uint64_t>(std::clamp(fill, 0.0f, 1.0f) * 4294967296.0);
+    RandomEngine::result_type random[64];
+    for (int base = 0; base < CELLS; base += 64) {
+      int count = std::min(CELLS - base, 64);
+      randomEngine.generate(random, count);
+      Word mask = 0;
+      for (int j = 0; j < count; ++j) {
+        mask |= Word{random[j] < threshold} << j;
+      }
+      cans[base / 64] = mask;
+    }
+    canCount = countCans();
+  }
+
+  BasicBitWorld(const BasicWorld<Width, Height, MaxSteps>& world)
+  {
+    for (int y = 0; y < HEIGHT; ++y) {
+      for (int x = 0; x < WIDTH; ++x) {
+        int cell = cellIndex(x, y);
+        cans[cell / 64] |= Word{world.hasCan[y][x]} << (cell % 64);
+      }
+    }
+    canCount = countCans();
+  }
+
+  static constexpr int cellIndex(int x, int y)
+  {
+    return y * WIDTH + x;
+  }
+
+  // Can mask as a little-endian bit string of PACKED_BYTES bytes (bit = cell), the layout of world corpus files.
+  static constexpr int PACKED_BYTES = (CELLS + 7) / 8;
+  static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "board words are copied as packed bytes");
+
+  static BasicBitWorld unpack(const uint8_t* bytes)
+  {
+    BasicBitWorld world;
+    std::memcpy(world.cans.data(), bytes, PACKED_BYTES);
+    // Padding bits past the last cell (WALL_BIT among them) must stay clear, whatever the bytes hold.
+    if (CELLS % 64 != 0) {
+      world.cans[CELLS / 64] &= (Word{1} << (CELLS % 64)) - 1;
+    }
+    world.canCount = world.countCans();
+    return world;
+  }
+
+  void pack(uint8_t* bytes) const
+  {
+    std::memcpy(bytes, cans.data(), PACKED_BYTES);
+  }
+
+  bool tryPickCan(int x, int y)
+  {
+    assert(isCoordinateValid(x, y));
+    return tryPickCan(cellIndex(x, y));
+  }
+
+  bool tryPickCan(int cell)
+  {
+    Word bit = Word{1} << (cell % 64);
+    bool hadCan = (cans[cell / 64] & bit) != 0;
+    cans[cell / 64] &= ~bit;
+    canCount -= hadCan;
+    return hadCan;
+  }
+
+  Input::State getState(int x, int y)
+  {
+    if (!isCoordinateValid(x, y)) {
+      return Input::State::WALL;
+    }
+    return hasCan(cellIndex(x, y)) ? Input::State::CAN : Input::State::EMPTY;
+  }
+
+  int getInputCode(int x, int y)
+  {
+    assert(isCoordinateValid(x, y));
+    return getInputCode(cellIndex(x, y));
+  }
+
+  int getInputCode(int cell) const
+  {
+    const Neighbourhood& n = NEIGHBOURHOOD[cell];
+    return n.wallCode
+         + CAN_CODE[0] * hasCan(n.bit[0])
+         + CAN_CODE[1] * hasCan(n.bit[1])
+         + CAN_CODE[2] * hasCan(n.bit[2])
+         + CAN_CODE[3] * hasCan(n.bit[3])
+         + CAN_CODE[4] * hasCan(n.bit[4]);
+  }
+
+  static const std::array<Neighbourhood, CELLS> NEIGHBOURHOOD;
+
+  // Cell reached by moving from `cell` in direction 1..4 (north, east, south, west), or WALL_BIT if blocked.
+  static int neighbour(int cell, int direction)
+  {
+    return NEIGHBOURHOOD[cell].bit[direction];
+  }
+
+  Input getInput(int x, int y)
+  {
+    return Input(getInputCode(x, y));
+  }
+
+  std::string toString()
+  {
+    std::string repr;
+    for (int y = HEIGHT-1; y >= 0; --y) {
+      for (int x = 0; x < WIDTH; ++x) {
+        char cellChar  = hasCan(cellIndex(x, y)) ? '+' : '.';
+        fmt::format_to(std::back_inserter(repr), "{} ", cellChar);
+      }
+      fmt::format_to(std::back_inserter(repr), "\n");
+    }
+    return repr;
+  }
+
+  bool isCoordinateValid(int x, int y)
+  {
+    return (0 <= x && x < WIDTH) && (0 <= y && y < HEIGHT);
+  }
+
+private:
+  int hasCan(int bit) const
+  {
+    return static_cast<int>(cans[bit / 64] >> (bit % 64)) & 1;
+  }
+
+  int countCans() const
+  {
+    int count = 0;
+    for (Word word : cans) {
+      count += __builtin_popcountll(word);
+    }
+    return count;
+  }
+
+  static constexpr std::array<Neighbourhood, CELLS> makeNeighbourhoods()
+  {
+    constexpr int dx[Input::LENGTH] = {0, 0, 1, 0, -1};
+    constexpr int dy[Input::LENGTH] = {0, 1, 0, -1, 0};
+    constexpr int weight[Input::LENGTH] = {81, 27, 9, 3, 1};
+    std::array<Neighbourhood, CELLS> table {};
+    for (int cell = 0; cell < CELLS; ++cell) {
+      int x = cell % WIDTH;
+      int y = cell / WIDTH;
+      Neighbourhood n {};
+      for (int i = 0; i < Input::LENGTH; ++i) {
+        int nx = x + dx[i];
+        int ny = y + dy[i];
+        bool inside = (0 <= nx && nx < WIDTH) && (0 <= ny && ny < HEIGHT);
+        n.bit[i] = inside ? cellIndex(nx, ny) : WALL_BIT;
+        n.wallCode += inside ? 0 : static_cast<int>(Input::State::WALL) * weight[i];
+      }
+      table[cell] = n;
+    }
+    return table;
   }
 };
 
+template <int Width, int Height, int MaxSteps>
+const std::array<typename BasicBitWorld<Width, Height, MaxSteps>::Neighbourhood, BasicBitWorld<Width, Height, MaxSteps>::CELLS>
+BasicBitWorld<Width, Height, MaxSteps>::NEIGHBOURHOOD = BasicBitWorld<Width, Height, MaxSteps>::makeNeighbourhoods();
+
+using BitWorld = BasicBitWorld<World::WIDTH, World::HEIGHT>;
+
+// Parents of the genes of a child, as drawn by Crossover::select(). Cut-point crossovers only record their cuts in
+// ascending order: genes before the first cut come from parents[0], and every cut switches between parents[0] and
+// parents[1]. Other crossovers name the parent of every gene in the selector.
+struct Recombination
+{
+  static constexpr int MAX_CUTS = 32;
+  bool bySelector = false;
+  int cutCount = 0;
+  int cuts[MAX_CUTS];
+  uint8_t selector[Input::COMBINATIONS];
+};
+
+// rule[i] = parent[i] wherever selector[i] == parentIndex, as a branch-free byte blend over the whole table which
+// the compiler maps onto vector registers.
+template <typename Action>
+void blendRules(Action* rule, const Action* parent, const uint8_t* selector, uint8_t parentIndex, int length)
+{
+  static_assert(sizeof(Action) == 1, "rules are blended as bytes");
+  auto* out = reinterpret_cast<uint8_t*>(rule);
+  const auto* in = reinterpret_cast<const uint8_t*>(parent);
+  for (int i = 0; i < length; ++i) {
+    uint8_t mask = -static_cast<uint8_t>(selector[i] == parentIndex);
+    out[i] = (out[i] & ~mask) | (in[i] & mask);
+  }
+}
+
+// Assembles the rule table of a child from parents[p]->rule: cut-point crossovers copy the runs between cuts,
+// the others blend every parent in through the selector.
+template <typename Genome, typename Action>
+void recombineRules(Action* rule, const Genome* const* parents, int parentCount, const Recombination& recombination, int length)
+{
+  if (!recombination.bySelector) {
+    int begin = 0;
+    for (int c = 0; c <= recombination.cutCount; ++c) {
+      int end = c < recombination.cutCount ? recombination.cuts[c] : length;
+      const Action* parent = parents[c % 2]->rule;
+      std::copy(parent + begin, parent + end, rule + begin);
+      begin = end;
+    }
+    return;
+  }
+  std::copy(parents[0]->rule, parents[0]->rule + length, rule);
+  for (int p = 1; p < parentCount; ++p) {
+    blendRules(rule, parents[p]->rule, recombination.selector, p, length);
+  }
+}
+
 struct RobotGenome
 {
   enum struct Action : int8_t {
@@ -157,23 +560,21 @@ struct RobotGenome
   static constexpr int LENGTH = Input::COMBINATIONS;
   Action rule[LENGTH];
 
-  RobotGenome(RandomArgs _) {
-    std::uniform_int_distribution<> uniformIntDistribution(0, static_cast<int>(Action::COUNT) - 1);
+  RobotGenome(RandomArgs _, RandomEngine& randomEngine) {
     for (auto&& _rule : rule) {
-      _rule = static_cast<Action>(uniformIntDistribution(randomEngine));
+      _rule = static_cast<Action>(randomEngine.below(static_cast<uint32_t>(Action::COUNT)));
     }
   }
 
-  RobotGenome(const RobotGenome& parentA, const RobotGenome& parentB)
+  // Child of parents[0, parentCount) with genes as drawn by Crossover::select().
+  RobotGenome(const RobotGenome* const* parents, int parentCount, const Recombination& recombination)
+  {
+    recombineRules(rule, parents, parentCount, recombination, RobotGenome::LENGTH);
+  }
+
+  Action action(int code) const
   {
-    // TODO: What will happen if this distribution is different (e.g. binomial)?
-    std::uniform_int_distribution<> geneIndexDist(0, static_cast<int>(RobotGenome::LENGTH) - 1);
-    int splitIndex = geneIndexDist(randomEngine);
-    assert(0 <= splitIndex && splitIndex < RobotGenome::LENGTH);
-    assert((std::fill(rule, rule + RobotGenome::LENGTH, Action::COUNT), true));
-    std::copy(parentA.rule, parentA.rule + splitIndex, rule);
-    std::copy(parentA.rule + splitIndex, parentA.rule + RobotGenome::LENGTH, rule + splitIndex);
-    assert(std::none_of(rule, rule + RobotGenome::LENGTH, [](auto&& action) {return action == Action::COUNT;}));
+    return rule[code];
   }
 
   std::string toString()
@@ -186,18 +587,19 @@ struct RobotGenome
   }
 
 
-  void mutate(int geneCount)
+  void mutate(int geneCount, RandomEngine& randomEngine)
   {
     assert(geneCount < RobotGenome::LENGTH);
-    std::uniform_int_distribution<> indexDist(0, static_cast<int>(RobotGenome::LENGTH) - 1);
-    std::uniform_int_distribution<> actionDist(0, static_cast<int>(Action::COUNT) - 1);
     for (int i = 0; i < geneCount; ++i) {
-
-      int mutatedIndex = indexDist(randomEngine);
-      rule[mutatedIndex] = static_cast<Action>(actionDist(randomEngine));
+      mutateGene(randomEngine.below(RobotGenome::LENGTH), randomEngine);
     }
   }
 
+  void mutateGene(int index, RandomEngine& randomEngine)
+  {
+    rule[index] = static_cast<Action>(randomEngine.below(static_cast<uint32_t>(Action::COUNT)));
+  }
+
 private:
   std::string actionToString(Action action)
   {
@@ -214,120 +616,2360 @@ private:
   }
 };
 
-void doSmokeTest()
+// Same rule table as RobotGenome packed into 3 bits per rule, 21 rules per 64-bit word (96 bytes instead of 243).
+// Offers the same constructors and draws the same random numbers, so it can replace RobotGenome transparently.
+struct PackedGenome
 {
-  fmt::print("Example world\n");
-  auto world = World(World::FILL);
-  fmt::print("{}", world.toString());
-  fmt::print("Total cans: {}\n", world.canCount);
-  fmt::print("Current input: {}\n", world.getInput(0, 0).toString());
-  fmt::print("\n");
+  using Action = RobotGenome::Action;
+  using RandomArgs = RobotGenome::RandomArgs;
+  static constexpr int LENGTH = RobotGenome::LENGTH;
+  static constexpr int BITS = 3;
+  static constexpr int RULES_PER_WORD = 64 / BITS;
+  static constexpr int WORDS = (LENGTH + RULES_PER_WORD - 1) / RULES_PER_WORD;
+  static constexpr uint64_t RULE_MASK = (uint64_t{1} << BITS) - 1;
+  static_assert(static_cast<int>(Action::COUNT) <= (1 << BITS));
+  uint64_t word[WORDS] = {0};
 
+  PackedGenome(RandomArgs _, RandomEngine& randomEngine)
+  {
+    for (int i = 0; i < LENGTH; ++i) {
+      set(i, static_cast<Action>(randomEngine.below(static_cast<uint32_t>(Action::COUNT))));
+    }
+  }
 
-  fmt::print("Input combinations + integer conversion\n");
-  for (int i = 0; i < Input::COMBINATIONS; ++i) {
-    fmt::print("{} -> {} -> {}\n", i, Input(i).toString(), static_cast<int>(Input(i)));
+  PackedGenome(const RobotGenome& genome)
+  {
+    for (int i = 0; i < LENGTH; ++i) {
+      set(i, genome.rule[i]);
+    }
   }
-  fmt::print("\n");
 
-  fmt::print("Random robot\n");
-  auto robot = RobotGenome(RobotGenome::RandomArgs{});
-  fmt::print("{}", robot.toString());
-  fmt::print("\n");
-}
+  // Every parent is blended in a whole word at a time. Cut-point crossovers build the mask of parents[1] straight
+  // from the cuts, as the XOR of the masks of the suffixes which start at them; otherwise the selector is widened
+  // into a bit mask per parent and word.
+  PackedGenome(const PackedGenome* const* parents, int parentCount, const Recombination& recombination)
+  {
+    if (!recombination.bySelector) {
+      uint64_t mask[WORDS] = {0};
+      for (int c = 0; c < recombination.cutCount; ++c) {
+        int cutWord = recombination.cuts[c] / RULES_PER_WORD;
+        uint64_t prefixMask = (uint64_t{1} << (BITS * (recombination.cuts[c] % RULES_PER_WORD))) - 1;
+        for (int w = 0; w < WORDS; ++w) {
+          mask[w] ^= w > cutWord ? ~uint64_t{0} : (w == cutWord ? ~prefixMask : 0);
+        }
+      }
+      for (int w = 0; w < WORDS; ++w) {
+        word[w] = (parents[0]->word[w] & ~mask[w]) | (parents[1]->word[w] & mask[w]);
+      }
+      return;
+    }
+    const uint8_t* selector = recombination.selector;
+    std::copy(parents[0]->word, parents[0]->word + WORDS, word);
+    for (int p = 1; p < parentCount; ++p) {
+      uint64_t mask[WORDS] = {0};
+      for (int i = 0; i < LENGTH; ++i) {
+        mask[i / RULES_PER_WORD] |= (-static_cast<uint64_t>(selector[i] == p) & RULE_MASK) << (BITS * (i % RULES_PER_WORD));
+      }
+      for (int w = 0; w < WORDS; ++w) {
+        word[w] = (word[w] & ~mask[w]) | (parents[p]->word[w] & mask[w]);
+      }
+    }
+  }
 
-std::vector<RobotGenome> breedNextGeneration(std::vector<RobotGenome>&& currentGeneration, const std::vector<float>& score, int mutationCount)
-{
-  std::vector<RobotGenome> nextGeneration;
-  std::vector<float> weights = score;
-  std::discrete_distribution<> sampleByScore{std::begin(weights), std::end(weights)};
+  Action action(int code) const
+  {
+    return static_cast<Action>((word[code / RULES_PER_WORD] >> (BITS * (code % RULES_PER_WORD))) & RULE_MASK);
+  }
 
-  nextGeneration.clear();
-  while (nextGeneration.size() < currentGeneration.size()) {
+  void set(int code, Action action)
+  {
+    int shift = BITS * (code % RULES_PER_WORD);
+    uint64_t& w = word[code / RULES_PER_WORD];
+    w = (w & ~(RULE_MASK << shift)) | (static_cast<uint64_t>(action) << shift);
+  }
 
-    int idxParentA = sampleByScore(randomEngine);
-    int idxParentB = sampleByScore(randomEngine);
-    if (idxParentA == idxParentB) {
-      continue;
+  void mutate(int geneCount, RandomEngine& randomEngine)
+  {
+    assert(geneCount < LENGTH);
+    for (int i = 0; i < geneCount; ++i) {
+      mutateGene(randomEngine.below(LENGTH), randomEngine);
     }
-    // fmt::print("child={}: {} + {}\n", nextGeneration.size(), score[idxParentA], score[idxParentB]);
-    RobotGenome&& child = RobotGenome(currentGeneration[idxParentA], currentGeneration[idxParentB]);
-    child.mutate(mutationCount);
+  }
 
-    nextGeneration.emplace_back(child);
+  void mutateGene(int index, RandomEngine& randomEngine)
+  {
+    set(index, static_cast<Action>(randomEngine.below(static_cast<uint32_t>(Action::COUNT))));
   }
-  return nextGeneration;
-}
+};
 
-float simulate(const RobotGenome& robotGenome, World& world, const int MAX_STEPS)
+// Marks the input codes which can actually occur in a width x height world, by enumerating every robot position
+// and every can pattern around it: the robot never stands on a wall, and e.g. both north and south walls are only
+// visible in a world which is one cell high.
+constexpr std::array<bool, Input::COMBINATIONS> reachableInputs(int width, int height)
 {
-  int rx = world.WIDTH / 2;
-  int ry = world.HEIGHT / 2;
-  float score = 0;
-  for (int s = 0; s < MAX_STEPS && world.canCount > 0; ++s) {
-    int dx = 0, dy = 0;
-    auto&& input = world.getInput(rx, ry);
-    RobotGenome::Action action = robotGenome.rule[static_cast<int>(input)];
-    std::uniform_int_distribution<> movesDist(0, RobotGenome::MoveAction.size() - 1);
-    if (action == RobotGenome::Action::MOVE_RANDOM) {
-        action = RobotGenome::MoveAction[movesDist(randomEngine)];
-    }
-    switch (action) {
-      case RobotGenome::Action::STAY_PUT:
-        break;
-      case RobotGenome::Action::TRY_PICK:
-        score += (world.tryPickCan(rx, ry) ? PICK_SUCCESS_PTS : PICK_FAIL_PTS);
-        break;
-      case RobotGenome::Action::MOVE_NORTH:
-        dy = 1;
-        break;
-      case RobotGenome::Action::MOVE_EAST:
-        dx = 1;
-        break;
-      case RobotGenome::Action::MOVE_SOUTH:
-        dy = -1;
-        break;
-      case RobotGenome::Action::MOVE_WEST:
-        dx = -1;
-        break;
-      default:
-        assert(false);
-    }
-    if (!world.isCoordinateValid(rx + dx, ry + dy)) {
-      score += WALL_HIT_PTS;
-      dx = 0;
-      dy = 0;
+  std::array<bool, Input::COMBINATIONS> reachable {};
+  constexpr int dx[Input::LENGTH] = {0, 0, 1, 0, -1};
+  constexpr int dy[Input::LENGTH] = {0, 1, 0, -1, 0};
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      for (int cans = 0; cans < (1 << Input::LENGTH); ++cans) {
+        int code = 0;
+        bool canOnWall = false;
+        for (int i = 0; i < Input::LENGTH; ++i) {
+          int nx = x + dx[i];
+          int ny = y + dy[i];
+          bool wall = !((0 <= nx && nx < width) && (0 <= ny && ny < height));
+          bool can = (cans >> i) & 1;
+          canOnWall |= wall && can;
+          auto state = wall ? Input::State::WALL : (can ? Input::State::CAN : Input::State::EMPTY);
+          code = code * static_cast<int>(Input::State::COUNT) + static_cast<int>(state);
+        }
+        reachable[code] |= !canOnWall;
+      }
     }
-    rx += dx;
-    ry += dy;
   }
-  return score;
+  return reachable;
 }
 
-// TODO: nothing prohibits us from using multiple parents to generate a single child :)
-int main()
+constexpr int countReachableInputs(const std::array<bool, Input::COMBINATIONS>& reachableInput)
 {
-  constexpr int N = 10000;
-  constexpr int mutationCount = 1;
-  std::vector<RobotGenome> robots;
-  std::vector<float> scores;
+  int count = 0;
+  for (bool reachable : reachableInput) {
+    count += reachable;
+  }
+  return count;
+}
 
-  // Generate initial population
-  for (int i = 0; i < N; ++i) {
-    robots.emplace_back(RobotGenome::RandomArgs{});
-    scores.emplace_back(1.0f / static_cast<float>(N));
+// Position of every input code in a genome which only stores reachable rules, -1 if the code cannot occur.
+constexpr std::array<int16_t, Input::COMBINATIONS> compactInputIndex(const std::array<bool, Input::COMBINATIONS>& reachableInput)
+{
+  std::array<int16_t, Input::COMBINATIONS> index {};
+  int16_t next = 0;
+  for (int code = 0; code < Input::COMBINATIONS; ++code) {
+    index[code] = reachableInput[code] ? next++ : -1;
   }
+  return index;
+}
 
-  fmt::print("generation,score\n");
-  for (int gen = 0; gen < 1e6; ++gen) {
-    robots = breedNextGeneration(std::move(robots), scores, mutationCount);
-    for (int i = 0; i < robots.size(); ++i) {
-      auto&& world = World(World::FILL);
-      float maxPoints = world.canCount * PICK_SUCCESS_PTS;
-      float points = simulate(robots[i], world, World::WIDTH * World::HEIGHT);
-      scores[i] = points > 0 ? points / maxPoints : 0;
+// Rule table restricted to the inputs which are reachable in WorldType (128 of 243 for 11x11), so that neither
+// mutation nor crossover is wasted on garbage DNA. Offers the same constructors as RobotGenome.
+template <typename WorldType>
+struct BasicCompactGenome
+{
+  using Action = RobotGenome::Action;
+  using RandomArgs = RobotGenome::RandomArgs;
+  static constexpr std::array<bool, Input::COMBINATIONS> REACHABLE = reachableInputs(WorldType::WIDTH, WorldType::HEIGHT);
+  static constexpr int LENGTH = countReachableInputs(REACHABLE);
+  static constexpr std::array<int16_t, Input::COMBINATIONS> INDEX = compactInputIndex(REACHABLE);
+  Action rule[LENGTH];
+
+  BasicCompactGenome(RandomArgs _, RandomEngine& randomEngine)
+  {
+    for (auto&& _rule : rule) {
+      _rule = static_cast<Action>(randomEngine.below(static_cast<uint32_t>(Action::COUNT)));
     }
-    float maxScore = *std::max_element(scores.begin(), scores.end());
-    fmt::print("{},{}\n", gen, maxScore);
+  }
+
+  BasicCompactGenome(const BasicCompactGenome* const* parents, int parentCount, const Recombination& recombination)
+  {
+    recombineRules(rule, parents, parentCount, recombination, LENGTH);
+  }
+
+  // Unreachable codes are never consulted by simulate(); they read as STAY_PUT so that genomes compare equal there.
+  Action action(int code) const
+  {
+    int index = INDEX[code];
+    return index < 0 ? Action::STAY_PUT : rule[index];
+  }
+
+  void mutate(int geneCount, RandomEngine& randomEngine)
+  {
+    assert(geneCount < LENGTH);
+    for (int i = 0; i < geneCount; ++i) {
+      mutateGene(randomEngine.below(LENGTH), randomEngine);
+    }
+  }
+
+  void mutateGene(int index, RandomEngine& randomEngine)
+  {
+    rule[index] = static_cast<Action>(randomEngine.below(static_cast<uint32_t>(Action::COUNT)));
+  }
+};
+
+using CompactGenome = BasicCompactGenome<World>;
+
+// How children are mutated: either exactly geneCount randomly chosen genes (which may coincide), or, with a
+// positive rate, every gene independently with that probability. The latter draws the number of untouched genes
+// before the next mutation from the geometric distribution, so its cost is proportional to the number of
+// mutations rather than to the number of genes.
+struct Mutation
+{
+  Mutation(int geneCount, double rate)
+  : geneCount(geneCount)
+  , rate(rate)
+  , logKeep(std::log1p(-rate))
+  {
+    assert(0 <= rate && rate <= 1);
+  }
+
+  bool perGene() const { return rate > 0; }
+
+  // Genes left untouched before the next mutated one: floor(log(u) / log(1 - rate)) for u uniform in (0, 1].
+  int64_t skip(RandomEngine& randomEngine) const
+  {
+    double gap = std::log(1.0 - randomEngine.uniform53()) / logKeep;
+    return gap < MAX_SKIP ? static_cast<int64_t>(gap) : MAX_SKIP;
+  }
+
+  int geneCount;
+  double rate;
+
+private:
+  static constexpr int64_t MAX_SKIP = std::numeric_limits<int64_t>::max() / 2;
+  double logKeep;
+};
+
+// Mutates every gene of genomes[0, count) with probability mutation.rate, treating the buffer as one long gene
+// sequence so that a whole chunk of the population takes a single pass.
+template <typename Genome>
+void mutatePopulation(Genome* genomes, int count, const Mutation& mutation, RandomEngine& randomEngine)
+{
+  assert(mutation.perGene());
+  const int64_t genes = int64_t{count} * Genome::LENGTH;
+  for (int64_t gene = mutation.skip(randomEngine); gene < genes; gene += 1 + mutation.skip(randomEngine)) {
+    genomes[gene / Genome::LENGTH].mutateGene(gene % Genome::LENGTH, randomEngine);
+  }
+}
+
+enum struct CrossoverMethod {
+  SINGLE_POINT, // prefix from the first parent, suffix from the second
+  K_POINT,      // the parents alternate after each of `points` cut points
+  UNIFORM,      // every gene from either parent with equal probability
+  MULTI_PARENT, // every gene from any of `parents` parents with equal probability
+};
+
+// How a child is recombined from its parents. select() draws the cut points of single- and k-point crossover, from
+// which the genome constructors copy whole runs of genes (or words), and the parent of every gene for the other
+// methods, which the constructors apply with branch-free blends.
+struct Crossover
+{
+  static constexpr int MAX_PARENTS = 8;
+  static constexpr int MAX_POINTS = Recombination::MAX_CUTS;
+  CrossoverMethod method = CrossoverMethod::SINGLE_POINT;
+  int points = 2;
+  int parents = 3;
+
+  int parentCount() const
+  {
+    return method == CrossoverMethod::MULTI_PARENT ? parents : 2;
+  }
+
+  void select(Recombination& recombination, int length, RandomEngine& randomEngine) const
+  {
+    assert(length <= Input::COMBINATIONS);
+    uint8_t* selector = recombination.selector;
+    recombination.bySelector = method == CrossoverMethod::UNIFORM || method == CrossoverMethod::MULTI_PARENT;
+    switch (method) {
+      case CrossoverMethod::SINGLE_POINT:
+        recombination.cutCount = 1;
+        recombination.cuts[0] = randomEngine.below(length);
+        return;
+      case CrossoverMethod::K_POINT:
+        // The parent switches at every cut, so a cut drawn twice cancels out.
+        recombination.cutCount = points;
+        for (int k = 0; k < points; ++k) {
+          recombination.cuts[k] = randomEngine.below(length);
+        }
+        std::sort(recombination.cuts, recombination.cuts + points);
+        return;
+      case CrossoverMethod::UNIFORM:
+        for (int i = 0; i < length; i += 32) {
+          uint32_t bits = randomEngine();
+          for (int j = 0; j < 32 && i + j < length; ++j) {
+            selector[i + j] = (bits >> j) & 1;
+          }
+        }
+        return;
+      case CrossoverMethod::MULTI_PARENT:
+        // One random byte per gene, scaled to [0, parents) by multiply-shift (bias below parents / 256).
+        for (int i = 0; i < length; i += 4) {
+          uint32_t bytes = randomEngine();
+          for (int j = 0; j < 4 && i + j < length; ++j) {
+            selector[i + j] = ((bytes >> (8 * j)) & 0xFF) * parents >> 8;
+          }
+        }
+        return;
+      default:
+        throw std::invalid_argument(fmt::format("invalid crossover method {}", static_cast<int>(method)));
+    }
+  }
+};
+
+void doSmokeTest()
+{
+  RandomEngine randomEngine({std::random_device()(), 0, 0, RandomEngine::Stream::INITIAL});
+  fmt::print("Example world\n");
+  auto world = World(World::FILL, randomEngine);
+  fmt::print("{}", world.toString());
+  fmt::print("Total cans: {}\n", world.canCount);
+  fmt::print("Current input: {}\n", world.getInput(0, 0).toString());
+  fmt::print("Current input (bit world): {}\n", BitWorld(world).getInput(0, 0).toString());
+  fmt::print("\n");
+
+
+  fmt::print("Input combinations + integer conversion\n");
+  for (int i = 0; i < Input::COMBINATIONS; ++i) {
+    fmt::print("{} -> {} -> {}\n", i, Input(i).toString(), static_cast<int>(Input(i)));
+  }
+  fmt::print("\n");
+
+  fmt::print("Random robot\n");
+  auto robot = RobotGenome(RobotGenome::RandomArgs{}, randomEngine);
+  fmt::print("{}", robot.toString());
+  fmt::print("\n");
+}
+
+// Fixed set of worker threads; the calling thread takes part in the work as worker 0.
+struct ThreadPool
+{
+  using Task = std::function<void(int begin, int end, int worker)>;
+
+  ThreadPool(int threadCount)
+  : workerCount(std::max(threadCount, 1))
+  {
+    for (int i = 1; i < workerCount; ++i) {
+      threads.emplace_back([this, i] { workerLoop(i); });
+    }
+  }
+
+  ~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wakeWorkers.notify_all();
+    for (auto&& thread : threads) {
+      thread.join();
+    }
+  }
+
+  int size() const
+  {
+    return workerCount;
+  }
+
+  // Splits [0, count) into chunks of chunkSize and runs task(begin, end, worker) on them; blocks until all are done.
+  void parallelFor(int count, int chunkSize, const Task& task)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      current = &task;
+      taskCount = count;
+      taskChunk = std::max(chunkSize, 1);
+      nextIndex = 0;
+      busyWorkers = size();
+      generation += 1;
+    }
+    wakeWorkers.notify_all();
+    runChunks(0);
+    std::unique_lock<std::mutex> lock(mutex);
+    allDone.wait(lock, [this] { return busyWorkers == 0; });
+    current = nullptr;
+  }
+
+private:
+  int workerCount;
+  std::vector<std::thread> threads;
+  std::mutex mutex;
+  std::condition_variable wakeWorkers;
+  std::condition_variable allDone;
+  const Task* current = nullptr;
+  int taskCount = 0;
+  int taskChunk = 1;
+  std::atomic<int> nextIndex = {0};
+  int busyWorkers = 0;
+  uint64_t generation = 0;
+  bool stopping = false;
+
+  void runChunks(int worker)
+  {
+    for (int begin = nextIndex.fetch_add(taskChunk); begin < taskCount; begin = nextIndex.fetch_add(taskChunk)) {
+      (*current)(begin, std::min(begin + taskChunk, taskCount), worker);
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    busyWorkers -= 1;
+    if (busyWorkers == 0) {
+      allDone.notify_one();
+    }
+  }
+
+  void workerLoop(int worker)
+  {
+    uint64_t seenGeneration = 0;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wakeWorkers.wait(lock, [&] { return stopping || generation != seenGeneration; });
+        if (stopping) {
+          return;
+        }
+        seenGeneration = generation;
+      }
+      runChunks(worker);
+    }
+  }
+};
+
+// Parent selection strategies. Both are built once per generation from the scores and are safe to sample
+// concurrently; a generation where nobody scored anything falls back to uniform sampling.
+enum struct SelectionMethod {
+  ROULETTE,
+  ALIAS,
+};
+
+// Roulette wheel: binary search over the cumulative weights, O(log N) per draw.
+struct RouletteSelection
+{
+  std::vector<double> cumulative;
+
+  RouletteSelection(const std::vector<float>& weights)
+  {
+    double total = 0;
+    for (auto&& weight : weights) {
+      total += std::max(weight, 0.0f);
+      cumulative.push_back(total);
+    }
+    if (total <= 0) {
+      std::iota(cumulative.begin(), cumulative.end(), 1.0);
+    }
+  }
+
+  int operator()(RandomEngine& randomEngine) const
+  {
+    auto it = std::upper_bound(cumulative.begin(), cumulative.end(), randomEngine.uniform53() * cumulative.back());
+    return std::min<int>(it - cumulative.begin(), cumulative.size() - 1);
+  }
+};
+
+// Vose's alias method: O(N) construction, O(1) per draw (one bucket index and one coin flip).
+struct AliasSelection
+{
+  std::vector<float> probability;
+  std::vector<int> alias;
+
+  AliasSelection(const std::vector<float>& weights)
+  : probability(weights.size(), 1.0f)
+  , alias(weights.size())
+  {
+    const int n = weights.size();
+    double total = 0;
+    for (auto&& weight : weights) {
+      total += std::max(weight, 0.0f);
+    }
+    std::iota(alias.begin(), alias.end(), 0);
+    if (total <= 0) {
+      return;
+    }
+    std::vector<double> scaled(n);
+    std::vector<int> small, large;
+    for (int i = 0; i < n; ++i) {
+      scaled[i] = std::max(weights[i], 0.0f) * n / total;
+      (scaled[i] < 1.0 ? small : large).push_back(i);
+    }
+    while (!small.empty() && !large.empty()) {
+      int less = small.back();
+      int more = large.back();
+      small.pop_back();
+      probability[less] = scaled[less];
+      alias[less] = more;
+      scaled[more] -= 1.0 - scaled[less];
+      if (scaled[more] < 1.0) {
+        large.pop_back();
+        small.push_back(more);
+      }
+    }
+    // Whatever is left over is 1.0 up to rounding errors.
+  }
+
+  int operator()(RandomEngine& randomEngine) const
+  {
+    int bucket = randomEngine.below(probability.size());
+    return randomEngine.uniform() < probability[bucket] ? bucket : alias[bucket];
+  }
+};
+
+// Two preallocated generations of genomes. Breeding reads current() and writes children in place into next(),
+// then the buffers are swapped, so the generation loop never allocates. Buffers are mapped directly from the
+// kernel and can optionally be backed by transparent huge pages.
+template <typename Genome>
+struct PopulationArena
+{
+  static_assert(std::is_trivially_copyable_v<Genome> && std::is_trivially_destructible_v<Genome>,
+                "genomes are stored in raw pages");
+
+  PopulationArena(int size, bool hugePages)
+  : count(size)
+  , bytes(std::max<size_t>(size * sizeof(Genome), 1))
+  {
+    for (auto&& generation : buffer) {
+      void* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (memory == MAP_FAILED) {
+        throw std::bad_alloc();
+      }
+      if (hugePages) {
+        madvise(memory, bytes, MADV_HUGEPAGE); // only a hint, failure is fine
+      }
+      generation = static_cast<Genome*>(memory);
+    }
+  }
+
+  PopulationArena(const PopulationArena&) = delete;
+  PopulationArena& operator=(const PopulationArena&) = delete;
+
+  ~PopulationArena()
+  {
+    for (auto&& generation : buffer) {
+      munmap(generation, bytes);
+    }
+  }
+
+  int size() const { return count; }
+  Genome* current() { return buffer[0]; }
+  Genome* next() { return buffer[1]; }
+  void swap() { std::swap(buffer[0], buffer[1]); }
+
+private:
+  int count;
+  size_t bytes;
+  Genome* buffer[2];
+};
+
+// Shared-memory ring through which island processes pass their best genomes on to the next island.
+// It is mapped before the islands are forked. Every island owns one mailbox and only reads the mailbox of
+// its predecessor; a mailbox is refilled only after its reader has taken the previous batch, so the exchange
+// is the same on every run and the islands stay reproducible from the seed.
+template <typename Genome>
+struct MigrationRing
+{
+  static_assert(std::is_trivially_copyable_v<Genome> && std::is_trivially_destructible_v<Genome>,
+                "genomes are stored in raw pages");
+  static_assert(std::atomic<int64_t>::is_always_lock_free, "mailboxes are shared between processes");
+
+  MigrationRing(int islands, int migrants)
+  : islands(islands)
+  , migrants(migrants)
+  {
+    // Mailboxes, then scores, then genomes, each suitably aligned.
+    size_t scoresOffset = islands * sizeof(Mailbox);
+    size_t genomesOffset = scoresOffset + islands * migrants * sizeof(float);
+    genomesOffset = (genomesOffset + alignof(Genome) - 1) / alignof(Genome) * alignof(Genome);
+    bytes = genomesOffset + islands * migrants * sizeof(Genome);
+    void* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+      throw std::bad_alloc();
+    }
+    mailbox = static_cast<Mailbox*>(memory);
+    scores = reinterpret_cast<float*>(static_cast<char*>(memory) + scoresOffset);
+    genomes = reinterpret_cast<Genome*>(static_cast<char*>(memory) + genomesOffset);
+    for (int i = 0; i < islands; ++i) {
+      new (&mailbox[i]) Mailbox();
+    }
+  }
+
+  MigrationRing(const MigrationRing&) = delete;
+  MigrationRing& operator=(const MigrationRing&) = delete;
+
+  ~MigrationRing()
+  {
+    munmap(mailbox, bytes);
+  }
+
+  int size() const { return islands; }
+  int migrantCount() const { return migrants; }
+
+  // Publishes population[indices[j]] for the next island; waits until it has taken the previous batch.
+  void send(int island, int64_t generation, const Genome* population, const float* populationScores, const int* indices)
+  {
+    Mailbox& box = mailbox[island];
+    while (box.consumed.load(std::memory_order_acquire) != box.published.load(std::memory_order_relaxed)) {
+      std::this_thread::yield();
+    }
+    for (int j = 0; j < migrants; ++j) {
+      new (&genomes[island * migrants + j]) Genome(population[indices[j]]);
+      scores[island * migrants + j] = populationScores[indices[j]];
+    }
+    box.published.store(generation, std::memory_order_release);
+  }
+
+  // Overwrites population[indices[j]] with the batch the previous island sent for this generation.
+  void receive(int island, int64_t generation, Genome* population, float* populationScores, const int* indices)
+  {
+    int source = (island + islands - 1) % islands;
+    Mailbox& box = mailbox[source];
+    while (box.published.load(std::memory_order_acquire) != generation) {
+      std::this_thread::yield();
+    }
+    for (int j = 0; j < migrants; ++j) {
+      population[indices[j]] = genomes[source * migrants + j];
+      populationScores[indices[j]] = scores[source * migrants + j];
+    }
+    box.consumed.store(generation, std::memory_order_release);
+  }
+
+private:
+  struct alignas(64) Mailbox {
+    std::atomic<int64_t> published = {-1}; // generation of the batch in the mailbox
+    std::atomic<int64_t> consumed = {-1};  // last generation taken by the next island
+  };
+  int islands;
+  int migrants;
+  size_t bytes;
+  Mailbox* mailbox;
+  float* scores;
+  Genome* genomes;
+};
+
+template <typename Genome, typename Selection>
+void breedNextGeneration(PopulationArena<Genome>& population, const Selection& sampleByScore, const Crossover& crossover, const Mutation& mutation, ThreadPool& pool, uint64_t seed, int generation, std::pair<int, int>* parents, const ThreadPool::Task& onBred)
+{
+  // Distinct parents are preferred, but a degenerate population (e.g. a single scoring robot) may self.
+  constexpr int MAX_PARENT_REDRAWS = 16;
+  const Genome* currentGeneration = population.current();
+  Genome* nextGeneration = population.next();
+
+  constexpr int chunkSize = 256;
+  pool.parallelFor(population.size(), chunkSize, [&](int begin, int end, int worker) {
+    const Genome* parentGenomes[Crossover::MAX_PARENTS];
+    Recombination recombination;
+    for (int i = begin; i < end; ++i) {
+      RandomEngine randomEngine({seed, static_cast<uint32_t>(generation), static_cast<uint32_t>(i), RandomEngine::Stream::BREED});
+      int idxParentA = sampleByScore(randomEngine);
+      int idxParentB = sampleByScore(randomEngine);
+      for (int redraw = 0; idxParentA == idxParentB && redraw < MAX_PARENT_REDRAWS; ++redraw) {
+        idxParentB = sampleByScore(randomEngine);
+      }
+      parentGenomes[0] = &currentGeneration[idxParentA];
+      parentGenomes[1] = &currentGeneration[idxParentB];
+      for (int p = 2; p < crossover.parentCount(); ++p) {
+        parentGenomes[p] = &currentGeneration[sampleByScore(randomEngine)];
+      }
+      crossover.select(recombination, Genome::LENGTH, randomEngine);
+      Genome* child = new (&nextGeneration[i]) Genome(parentGenomes, crossover.parentCount(), recombination);
+      if (!mutation.perGene()) {
+        child->mutate(mutation.geneCount, randomEngine);
+      }
+      if (parents != nullptr) {
+        parents[i] = {idxParentA, idxParentB};
+      }
+    }
+    if (mutation.perGene()) {
+      // Chunks start at multiples of chunkSize whatever the thread count, so they key the stream.
+      RandomEngine randomEngine({seed, static_cast<uint32_t>(generation), static_cast<uint32_t>(begin), RandomEngine::Stream::MUTATE});
+      mutatePopulation(&nextGeneration[begin], end - begin, mutation, randomEngine);
+    }
+    if (onBred) {
+      onBred(begin, end, worker);
+    }
+  });
+  population.swap();
+}
+
+// Optionally reports the first two parents of every child, indexed into the previous generation (now population.next()).
+// onBred(begin, end, worker) is run by the breeding worker on every finished chunk of children, which at that
+// point still live in population.next(); it lets callers start working on them without waiting for the rest.
+template <typename Genome>
+void breedNextGeneration(PopulationArena<Genome>& population, const std::vector<float>& score, const Crossover& crossover, const Mutation& mutation, ThreadPool& pool, uint64_t seed, int generation, SelectionMethod method, std::pair<int, int>* parents = nullptr, const ThreadPool::Task& onBred = nullptr)
+{
+  switch (method) {
+    case SelectionMethod::ROULETTE:
+      return breedNextGeneration(population, RouletteSelection(score), crossover, mutation, pool, seed, generation, parents, onBred);
+    case SelectionMethod::ALIAS:
+      return breedNextGeneration(population, AliasSelection(score), crossover, mutation, pool, seed, generation, parents, onBred);
+    default:
+      throw std::invalid_argument(fmt::format("invalid selection method {}", static_cast<int>(method)));
+  }
+}
+
+// Set of rules (input codes) consulted by a genome during a simulation.
+struct RuleUsage
+{
+  uint64_t bits[(Input::COMBINATIONS + 63) / 64] = {0};
+
+  void mark(int code)
+  {
+    bits[code >> 6] |= uint64_t{1} << (code & 63);
+  }
+
+  bool test(int code) const
+  {
+    return (bits[code >> 6] >> (code & 63)) & 1;
+  }
+
+  static RuleUsage all()
+  {
+    RuleUsage usage;
+    std::fill(std::begin(usage.bits), std::end(usage.bits), ~uint64_t{0});
+    return usage;
+  }
+
+  RuleUsage& operator|=(const RuleUsage& other)
+  {
+    for (std::size_t i = 0; i < std::size(bits); ++i) {
+      bits[i] |= other.bits[i];
+    }
+    return *this;
+  }
+};
+
+// A genome which agrees with `parent` on every rule the parent consulted replays the parent's run exactly
+// (same world, same random stream), so it would get exactly the same score.
+template <typename Genome>
+bool behavesLike(const Genome& genome, const Genome& parent, const RuleUsage& parentUsage)
+{
+  for (int code = 0; code < Input::COMBINATIONS; ++code) {
+    if (parentUsage.test(code) && genome.action(code) != parent.action(code)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Detects a robot returning to a (cell, cans) state it has already visited since the last random move or successful
+// pick. Everything in between was deterministic and left the world untouched, so the run is periodic from there on
+// and all remaining whole cycles can be skipped by multiplying the per-cycle score delta.
+template <int CELLS>
+struct CycleDetector
+{
+  struct Visit {
+    uint32_t epoch;
+    int32_t step;
+    float score;
+  };
+  Visit visit[CELLS] = {};
+  uint32_t epoch = 1;
+
+  // Forgets all visits; call after an action which was random or changed the world.
+  void reset()
+  {
+    epoch += 1;
+  }
+
+  // Records the state before `step` is executed, or fast-forwards step and score if this state closes a cycle.
+  void observe(int cell, int& step, float& score, const int MAX_STEPS)
+  {
+    Visit& v = visit[cell];
+    if (v.epoch != epoch) {
+      v = {epoch, step, score};
+      return;
+    }
+    int period = step - v.step;
+    int cycles = (MAX_STEPS - step) / period;
+    score += cycles * (score - v.score);
+    step += cycles * period;
+    reset(); // what is left is shorter than one cycle
+  }
+};
+
+// Specialized stepping engine for BitWorld: the robot is tracked as a cell index and the rule index is kept live
+// between steps. Picking a can subtracts a constant, bumping into a wall or staying put leaves it unchanged,
+// and only a successful move re-reads the (table-driven) neighbourhood of the destination cell.
+// If `usage` is given, it receives the set of rules consulted.
+template <typename Genome, int Width, int Height, int MaxSteps>
+float simulate(const Genome& robotGenome, BasicBitWorld<Width, Height, MaxSteps>& world, RandomEngine& randomEngine, RuleUsage* usage = nullptr)
+{
+  using BitWorld = BasicBitWorld<Width, Height, MaxSteps>;
+  constexpr int MAX_STEPS = MaxSteps;
+  int cell = BitWorld::cellIndex(BitWorld::WIDTH / 2, BitWorld::HEIGHT / 2);
+  int code = world.getInputCode(cell);
+  float score = 0;
+  CycleDetector<BitWorld::CELLS> cycles;
+  uint32_t moveBits = 0; // 16 random moves per engine word, 2 bits each
+  int movesLeft = 0;
+  for (int s = 0; s < MAX_STEPS && world.canCount > 0; ++s) {
+    cycles.observe(cell, s, score, MAX_STEPS);
+    if (s >= MAX_STEPS) {
+      break;
+    }
+    assert(code == world.getInputCode(cell));
+    if (usage != nullptr) {
+      usage->mark(code);
+    }
+    RobotGenome::Action action = robotGenome.action(code);
+    if (action == RobotGenome::Action::MOVE_RANDOM) {
+      if (movesLeft == 0) {
+        moveBits = randomEngine();
+        movesLeft = 16;
+      }
+      action = RobotGenome::MoveAction[moveBits & 3];
+      moveBits >>= 2;
+      --movesLeft;
+      cycles.reset();
+    }
+    switch (action) {
+      case RobotGenome::Action::STAY_PUT:
+        break;
+      case RobotGenome::Action::TRY_PICK:
+        if (world.tryPickCan(cell)) {
+          score += PICK_SUCCESS_PTS;
+          code -= BitWorld::CAN_CODE[0];
+          cycles.reset();
+        }
+        else {
+          score += PICK_FAIL_PTS;
+        }
+        break;
+      case RobotGenome::Action::MOVE_NORTH:
+      case RobotGenome::Action::MOVE_EAST:
+      case RobotGenome::Action::MOVE_SOUTH:
+      case RobotGenome::Action::MOVE_WEST: {
+        int direction = 1 + static_cast<int>(action) - static_cast<int>(RobotGenome::Action::MOVE_NORTH);
+        int target = BitWorld::neighbour(cell, direction);
+        if (target == BitWorld::WALL_BIT) {
+          score += WALL_HIT_PTS;
+          break;
+        }
+        cell = target;
+        code = world.getInputCode(cell);
+        break;
+      }
+      default:
+        assert(false);
+    }
+  }
+  return score;
+}
+
+// 128-bit hash of a genome's bytes, from two independently seeded multiply-xorshift lanes.
+struct GenomeHash
+{
+  uint64_t lo = 0;
+  uint64_t hi = 0;
+
+  bool operator==(const GenomeHash& other) const { return lo == other.lo && hi == other.hi; }
+  bool operator<(const GenomeHash& other) const { return lo != other.lo ? lo < other.lo : hi < other.hi; }
+};
+
+template <typename Genome>
+GenomeHash hashGenome(const Genome& genome)
+{
+  static_assert(std::is_trivially_copyable_v<Genome>);
+  auto mix = [](uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCD;
+    x ^= x >> 33;
+    x *= 0xC4CEB9FE1A85EC53;
+    x ^= x >> 33;
+    return x;
+  };
+  const auto* bytes = reinterpret_cast<const unsigned char*>(&genome);
+  uint64_t a = 0x9E3779B97F4A7C15;
+  uint64_t b = 0xD6E8FEB86659FD93;
+  for (size_t i = 0; i < sizeof(Genome); i += sizeof(uint64_t)) {
+    uint64_t word = 0;
+    std::memcpy(&word, bytes + i, std::min(sizeof(uint64_t), sizeof(Genome) - i));
+    a = (a ^ word) * 0x9FB21C651E98DF25;
+    a = (a << 29) | (a >> 35);
+    b = (b + word) * 0xC2B2AE3D27D4EB4F;
+    b = (b << 31) | (b >> 33);
+  }
+  GenomeHash hash {mix(a ^ sizeof(Genome)), mix(b + sizeof(Genome))};
+  hash.lo |= 1; // {0, 0} marks an empty cache slot
+  return hash;
+}
+
+// Concurrent open-addressing table from genome hash to running fitness statistics (Welford mean and variance
+// over every world the genome was scored on). Each slot is guarded by its own spinlock. Probing is bounded;
+// when the whole probe window is taken, the least sampled entry is evicted. Which entries survive therefore
+// depends on the order of add() calls, so callers which want reproducible runs make them in a fixed order.
+struct FitnessCache
+{
+  struct Stats {
+    uint32_t count = 0;
+    float mean = 0;
+    float m2 = 0;
+    int32_t epoch = -1; // world epoch of the latest samples; the same worlds are never counted twice
+  };
+
+  FitnessCache(int log2Slots)
+  : slots(size_t{1} << log2Slots)
+  , mask((uint64_t{1} << log2Slots) - 1) { }
+
+  bool find(const GenomeHash& key, Stats& stats)
+  {
+    for (int p = 0; p < PROBES; ++p) {
+      Slot& slot = slots[(key.lo + p) & mask];
+      SlotLock lock(slot);
+      if (slot.key == key) {
+        stats = slot.stats;
+        return true;
+      }
+      if (slot.key == GenomeHash{}) {
+        return false;
+      }
+    }
+    return false;
+  }
+
+  // Merges `samples` into the entry for `key` (unless it already holds samples from `samples.epoch`); returns the result.
+  Stats add(const GenomeHash& key, const Stats& samples)
+  {
+    int victim = 0;
+    uint32_t victimCount = std::numeric_limits<uint32_t>::max();
+    for (int p = 0; p < PROBES; ++p) {
+      Slot& slot = slots[(key.lo + p) & mask];
+      SlotLock lock(slot);
+      if (slot.key == GenomeHash{}) {
+        slot.key = key;
+        slot.stats = samples;
+        return slot.stats;
+      }
+      if (slot.key == key) {
+        if (slot.stats.epoch != samples.epoch) {
+          slot.stats = merge(slot.stats, samples);
+        }
+        return slot.stats;
+      }
+      if (slot.stats.count < victimCount) {
+        victimCount = slot.stats.count;
+        victim = p;
+      }
+    }
+    Slot& slot = slots[(key.lo + victim) & mask];
+    SlotLock lock(slot);
+    slot.key = key;
+    slot.stats = samples;
+    return slot.stats;
+  }
+
+  // Chan et al. parallel update of count, mean and sum of squared deviations.
+  static Stats merge(const Stats& a, const Stats& b)
+  {
+    if (a.count == 0) return b;
+    if (b.count == 0) return a;
+    Stats merged;
+    merged.count = a.count + b.count;
+    float delta = b.mean - a.mean;
+    merged.mean = a.mean + delta * b.count / merged.count;
+    merged.m2 = a.m2 + b.m2 + delta * delta * a.count * b.count / merged.count;
+    merged.epoch = std::max(a.epoch, b.epoch);
+    return merged;
+  }
+
+private:
+  static constexpr int PROBES = 8;
+  struct Slot {
+    std::atomic<bool> locked = {false};
+    GenomeHash key;
+    Stats stats;
+  };
+  struct SlotLock {
+    Slot& slot;
+    SlotLock(Slot& slot) : slot(slot) { while (slot.locked.exchange(true, std::memory_order_acquire)) { } }
+    ~SlotLock() { slot.locked.store(false, std::memory_order_release); }
+  };
+  std::vector<Slot> slots;
+  uint64_t mask;
+};
+
+enum struct GenomeFormat {
+  BYTES,
+  PACKED,
+  COMPACT,
+};
+
+enum struct Engine {
+  GENERATIONAL,
+  STEADY_STATE,
+};
+
+// Command line options, given as --name=value.
+struct Options
+{
+  uint64_t seed = std::random_device()();
+  SelectionMethod selection = SelectionMethod::ALIAS;
+  bool hugePages = false;
+  GenomeFormat genome = GenomeFormat::BYTES;
+  int worlds = 1;
+  int worldEpoch = 1;
+  bool reuseFitness = false;
+  int cacheSamples = 0;
+  int cacheLog2Slots = 20;
+  int width = World::WIDTH;
+  int height = World::HEIGHT;
+  bool pipeline = true;
+  Engine engine = Engine::GENERATIONAL;
+  int threads = std::max<int>(std::thread::hardware_concurrency(), 1);
+  int islands = 1;
+  int migrationInterval = 10;
+  int migrants = 10;
+  int raceWorlds = 0;
+  float raceConfidence = 1.0f;
+  int worldProducers = 1;
+  std::string corpus;      // world corpus to score on instead of worlds drawn from the seed
+  std::string writeCorpus; // write a world corpus of corpusWorlds worlds instead of evolving
+  int64_t corpusWorlds = 1000000;
+  std::string listen;  // coordinator: socket on which evaluation workers connect
+  std::string connect; // worker: socket of the coordinator
+  double mutationRate = 0; // per-gene mutation probability; 0 mutates exactly one gene per child
+  CrossoverMethod crossover = CrossoverMethod::SINGLE_POINT;
+  int crossoverPoints = 2;  // for k-point crossover
+  int crossoverParents = 3; // for multi-parent crossover
+
+  static constexpr const char* USAGE =
+    "usage: evolve [--name=value ...]\n"
+    "  --seed=N  --threads=N  --size=WxH (10x10, 11x11, 16x16, 32x32)\n"
+    "  --genome=bytes|packed|compact  --selection=alias|roulette  --engine=generational|steady-state\n"
+    "  --pipeline=0|1  --huge-pages=0|1\n"
+    "  --crossover=single-point|k-point|uniform|multi-parent  --crossover-points=N  --crossover-parents=N\n"
+    "  --mutation-rate=P  --worlds=K  --world-epoch=N  --world-producers=N\n"
+    "  --reuse-fitness=0|1  --cache-samples=N  --cache-slots-log2=N  --race-worlds=N  --race-confidence=Z\n"
+    "  --islands=N  --migration-interval=N  --migrants=N  --listen=PATH  --connect=PATH\n"
+    "  --corpus=PATH  --write-corpus=PATH  --corpus-worlds=N\n";
+
+  static Options parse(int argc, char** argv)
+  {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+      std::string_view arg = argv[i];
+      auto separator = arg.find('=');
+      if (arg.substr(0, 2) != "--" || separator == std::string_view::npos) {
+        throw std::invalid_argument(fmt::format("expected --name=value, got {}", arg));
+      }
+      std::string_view name = arg.substr(2, separator - 2);
+      std::string value {arg.substr(separator + 1)};
+      if (name == "seed") {
+        options.seed = std::stoull(value);
+      }
+      else if (name == "selection") {
+        options.selection = parseSelection(value);
+      }
+      else if (name == "huge-pages") {
+        options.hugePages = std::stoi(value) != 0;
+      }
+      else if (name == "genome") {
+        options.genome = parseGenome(value);
+      }
+      else if (name == "worlds") {
+        options.worlds = std::stoi(value);
+        if (options.worlds < 1) {
+          throw std::invalid_argument(fmt::format("need at least one world, got {}", value));
+        }
+      }
+      else if (name == "world-epoch") {
+        options.worldEpoch = std::stoi(value);
+        if (options.worldEpoch < 1) {
+          throw std::invalid_argument(fmt::format("world epoch must be at least one generation, got {}", value));
+        }
+      }
+      else if (name == "reuse-fitness") {
+        options.reuseFitness = std::stoi(value) != 0;
+      }
+      else if (name == "cache-samples") {
+        options.cacheSamples = std::stoi(value);
+        if (options.cacheSamples < 0) {
+          throw std::invalid_argument(fmt::format("invalid number of cache samples {}", value));
+        }
+      }
+      else if (name == "cache-slots-log2") {
+        options.cacheLog2Slots = std::stoi(value);
+        if (!(0 <= options.cacheLog2Slots && options.cacheLog2Slots <= 32)) {
+          throw std::invalid_argument(fmt::format("cache slots log2 must be in [0, 32], got {}", value));
+        }
+      }
+      else if (name == "size") {
+        parseSize(value, options.width, options.height);
+      }
+      else if (name == "pipeline") {
+        options.pipeline = std::stoi(value) != 0;
+      }
+      else if (name == "engine") {
+        options.engine = parseEngine(value);
+      }
+      else if (name == "threads") {
+        options.threads = std::stoi(value);
+        if (options.threads < 1) {
+          throw std::invalid_argument(fmt::format("need at least one thread, got {}", value));
+        }
+      }
+      else if (name == "islands") {
+        options.islands = std::stoi(value);
+        if (options.islands < 1) {
+          throw std::invalid_argument(fmt::format("need at least one island, got {}", value));
+        }
+      }
+      else if (name == "migration-interval") {
+        options.migrationInterval = std::stoi(value);
+        if (options.migrationInterval < 1) {
+          throw std::invalid_argument(fmt::format("migration interval must be at least one generation, got {}", value));
+        }
+      }
+      else if (name == "race-worlds") {
+        options.raceWorlds = std::stoi(value);
+        if (options.raceWorlds < 0) {
+          throw std::invalid_argument(fmt::format("invalid number of racing worlds {}", value));
+        }
+      }
+      else if (name == "corpus") {
+        options.corpus = value;
+      }
+      else if (name == "write-corpus") {
+        options.writeCorpus = value;
+      }
+      else if (name == "corpus-worlds") {
+        options.corpusWorlds = std::stoll(value);
+        if (options.corpusWorlds < 1) {
+          throw std::invalid_argument(fmt::format("need at least one corpus world, got {}", value));
+        }
+      }
+      else if (name == "world-producers") {
+        options.worldProducers = std::stoi(value);
+        if (options.worldProducers < 1) {
+          throw std::invalid_argument(fmt::format("need at least one world producer, got {}", value));
+        }
+      }
+      else if (name == "race-confidence") {
+        options.raceConfidence = std::stof(value);
+      }
+      else if (name == "listen") {
+        options.listen = value;
+      }
+      else if (name == "connect") {
+        options.connect = value;
+      }
+      else if (name == "mutation-rate") {
+        options.mutationRate = std::stod(value);
+        if (!(0 <= options.mutationRate && options.mutationRate <= 1)) {
+          throw std::invalid_argument(fmt::format("mutation rate must be in [0, 1], got {}", value));
+        }
+      }
+      else if (name == "crossover") {
+        options.crossover = parseCrossover(value);
+      }
+      else if (name == "crossover-points") {
+        options.crossoverPoints = std::stoi(value);
+        if (options.crossoverPoints < 1 || options.crossoverPoints > Crossover::MAX_POINTS) {
+          throw std::invalid_argument(fmt::format("crossover points must be in [1, {}], got {}", Crossover::MAX_POINTS, value));
+        }
+      }
+      else if (name == "crossover-parents") {
+        options.crossoverParents = std::stoi(value);
+        if (options.crossoverParents < 2 || options.crossoverParents > Crossover::MAX_PARENTS) {
+          throw std::invalid_argument(fmt::format("crossover parents must be in [2, {}], got {}", Crossover::MAX_PARENTS, value));
+        }
+      }
+      else if (name == "migrants") {
+        options.migrants = std::stoi(value);
+        if (options.migrants < 0) {
+          throw std::invalid_argument(fmt::format("invalid number of migrants {}", value));
+        }
+        // The best robots leave and immigrants replace the worst ones; the two sets must not overlap.
+        if (options.migrants > POPULATION_SIZE / 2) {
+          throw std::invalid_argument(fmt::format("at most {} migrants fit a population of {}, got {}", POPULATION_SIZE / 2, POPULATION_SIZE, value));
+        }
+      }
+      else {
+        throw std::invalid_argument(fmt::format("unknown option {}", name));
+      }
+    }
+    return options;
+  }
+
+private:
+  static SelectionMethod parseSelection(const std::string& value)
+  {
+    if (value == "roulette") return SelectionMethod::ROULETTE;
+    if (value == "alias") return SelectionMethod::ALIAS;
+    throw std::invalid_argument(fmt::format("invalid selection method {}", value));
+  }
+
+  static GenomeFormat parseGenome(const std::string& value)
+  {
+    if (value == "bytes") return GenomeFormat::BYTES;
+    if (value == "packed") return GenomeFormat::PACKED;
+    if (value == "compact") return GenomeFormat::COMPACT;
+    throw std::invalid_argument(fmt::format("invalid genome format {}", value));
+  }
+
+  static CrossoverMethod parseCrossover(const std::string& value)
+  {
+    if (value == "single-point") return CrossoverMethod::SINGLE_POINT;
+    if (value == "k-point") return CrossoverMethod::K_POINT;
+    if (value == "uniform") return CrossoverMethod::UNIFORM;
+    if (value == "multi-parent") return CrossoverMethod::MULTI_PARENT;
+    throw std::invalid_argument(fmt::format("invalid crossover method {}", value));
+  }
+
+  static Engine parseEngine(const std::string& value)
+  {
+    if (value == "generational") return Engine::GENERATIONAL;
+    if (value == "steady-state") return Engine::STEADY_STATE;
+    throw std::invalid_argument(fmt::format("invalid engine {}", value));
+  }
+
+  static void parseSize(const std::string& value, int& width, int& height)
+  {
+    auto separator = value.find('x');
+    if (separator == std::string::npos) {
+      throw std::invalid_argument(fmt::format("expected WIDTHxHEIGHT, got {}", value));
+    }
+    width = std::stoi(value.substr(0, separator));
+    height = std::stoi(value.substr(separator + 1));
+  }
+};
+
+// Fixed set of worlds on disk, so that benchmark and regression runs score genomes on the same worlds whatever the
+// seed. The file is a CorpusHeader followed by `count` packed can masks (16 bytes per 11x11 world); it is mapped
+// read-only and a world is only copied out into a mutable BitWorld when a simulation needs it.
+struct CorpusHeader
+{
+  static constexpr char MAGIC[8] = {'R', 'O', 'B', 'Y', 'W', 'R', 'L', 'D'};
+  static constexpr uint32_t VERSION = 1;
+  char magic[8];
+  uint32_t version;
+  uint16_t width;
+  uint16_t height;
+  uint64_t count;
+  uint32_t recordBytes;
+  uint32_t reserved;
+};
+
+template <typename BitWorld>
+struct WorldCorpus
+{
+  WorldCorpus(const std::string& path)
+  {
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat status {};
+    if (fd < 0 || fstat(fd, &status) < 0) {
+      int error = errno;
+      if (fd >= 0) {
+        close(fd);
+      }
+      throw std::runtime_error(fmt::format("cannot open world corpus {}: {}", path, std::strerror(error)));
+    }
+    bytes = status.st_size;
+    void* memory = bytes >= sizeof(CorpusHeader) ? mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (memory == MAP_FAILED) {
+      throw std::runtime_error(fmt::format("cannot map world corpus {}", path));
+    }
+    header = static_cast<const CorpusHeader*>(memory);
+    records = static_cast<const uint8_t*>(memory) + sizeof(CorpusHeader);
+    bool valid = std::memcmp(header->magic, CorpusHeader::MAGIC, sizeof(header->magic)) == 0
+              && header->version == CorpusHeader::VERSION
+              && header->recordBytes == BitWorld::PACKED_BYTES
+              && header->count > 0
+              && header->count <= (bytes - sizeof(CorpusHeader)) / header->recordBytes
+              && bytes == sizeof(CorpusHeader) + header->count * header->recordBytes;
+    if (!valid || header->width != BitWorld::WIDTH || header->height != BitWorld::HEIGHT) {
+      munmap(memory, bytes);
+      throw std::invalid_argument(fmt::format("{} is not a world corpus for {}x{} worlds", path, BitWorld::WIDTH, BitWorld::HEIGHT));
+    }
+  }
+
+  WorldCorpus(const WorldCorpus&) = delete;
+  WorldCorpus& operator=(const WorldCorpus&) = delete;
+
+  ~WorldCorpus()
+  {
+    munmap(const_cast<CorpusHeader*>(header), bytes);
+  }
+
+  int64_t size() const { return header->count; }
+
+  BitWorld operator[](int64_t index) const
+  {
+    return BitWorld::unpack(records + index * BitWorld::PACKED_BYTES);
+  }
+
+  // Generates `count` worlds from `seed` (world i from the WORLD stream of individual i) and writes them to `path`.
+  static void write(const std::string& path, int64_t count, uint64_t seed)
+  {
+    std::unique_ptr<std::FILE, int (*)(std::FILE*)> file(std::fopen(path.c_str(), "wb"), &std::fclose);
+    if (!file) {
+      throw std::runtime_error(fmt::format("cannot create world corpus {}: {}", path, std::strerror(errno)));
+    }
+    CorpusHeader header {};
+    std::memcpy(header.magic, CorpusHeader::MAGIC, sizeof(header.magic));
+    header.version = CorpusHeader::VERSION;
+    header.width = BitWorld::WIDTH;
+    header.height = BitWorld::HEIGHT;
+    header.count = count;
+    header.recordBytes = BitWorld::PACKED_BYTES;
+    bool ok = std::fwrite(&header, sizeof(header), 1, file.get()) == 1;
+    uint8_t record[BitWorld::PACKED_BYTES];
+    for (int64_t i = 0; i < count && ok; ++i) {
+      RandomEngine randomEngine({seed, 0, static_cast<uint32_t>(i), RandomEngine::Stream::WORLD, static_cast<uint32_t>(i >> 32)});
+      BitWorld(BitWorld::FILL, randomEngine).pack(record);
+      ok = std::fwrite(record, sizeof(record), 1, file.get()) == 1;
+    }
+    if (!ok || std::fflush(file.get()) != 0) {
+      throw std::runtime_error(fmt::format("cannot write world corpus {}: {}", path, std::strerror(errno)));
+    }
+  }
+
+private:
+  const CorpusHeader* header;
+  const uint8_t* records;
+  size_t bytes;
+};
+
+// Worlds of one epoch, the same in every process which knows the run seed (or uses the same corpus).
+// Epoch number e (the one starting at generation epochStart) reads the e-th block of worlds.size() corpus worlds.
+template <typename BitWorld>
+void makeWorlds(uint64_t seed, int epochStart, int epochNumber, std::vector<BitWorld>& worlds, const WorldCorpus<BitWorld>* corpus = nullptr)
+{
+  for (size_t k = 0; k < worlds.size(); ++k) {
+    if (corpus != nullptr) {
+      worlds[k] = (*corpus)[(static_cast<int64_t>(epochNumber) * worlds.size() + k) % corpus->size()];
+      continue;
+    }
+    RandomEngine randomEngine({seed, static_cast<uint32_t>(epochStart), 0, RandomEngine::Stream::WORLD, static_cast<uint32_t>(k)});
+    worlds[k] = BitWorld(BitWorld::FILL, randomEngine);
+  }
+}
+
+// Long-lived thread which builds the worlds of the next epoch while the current one is being scored.
+template <typename BitWorld>
+struct WorldPrefetcher
+{
+  WorldPrefetcher(uint64_t seed, int worldCount, const WorldCorpus<BitWorld>* corpus)
+  : seed(seed)
+  , corpus(corpus)
+  , worlds(worldCount)
+  , thread([this] { produce(); }) { }
+
+  WorldPrefetcher(const WorldPrefetcher&) = delete;
+  WorldPrefetcher& operator=(const WorldPrefetcher&) = delete;
+
+  ~WorldPrefetcher()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wakeProducer.notify_one();
+    thread.join();
+  }
+
+  // Starts building the worlds of the epoch at epochStart; the previous request must have been taken.
+  void request(int epochStart, int epochNumber)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      requestedStart = epochStart;
+      requestedNumber = epochNumber;
+      pending = true;
+    }
+    wakeProducer.notify_one();
+  }
+
+  // Waits for the requested worlds and swaps them into `out`, which must hold as many worlds.
+  void take(std::vector<BitWorld>& out)
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return !pending; });
+    std::swap(out, worlds);
+  }
+
+private:
+  uint64_t seed;
+  const WorldCorpus<BitWorld>* corpus;
+  std::vector<BitWorld> worlds; // owned by the producer while a request is pending
+  std::mutex mutex;
+  std::condition_variable wakeProducer;
+  std::condition_variable done;
+  int requestedStart = 0;
+  int requestedNumber = 0;
+  bool pending = false;
+  bool stopping = false;
+  std::thread thread; // last, so that it starts after everything it uses
+
+  void produce()
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      wakeProducer.wait(lock, [this] { return stopping || pending; });
+      if (stopping) {
+        return;
+      }
+      int epochStart = requestedStart;
+      int epochNumber = requestedNumber;
+      lock.unlock();
+      makeWorlds(seed, epochStart, epochNumber, worlds, corpus);
+      lock.lock();
+      pending = false;
+      done.notify_one();
+    }
+  }
+};
+
+// Outcome of one genome on all worlds of an epoch: mean normalized score, sum of squared scores, rules consulted.
+struct Evaluation
+{
+  float score;
+  float square;
+  RuleUsage usage;
+};
+
+// Scores genomes[indices[j]] (genomes[j] without indices) on worlds [firstWorld, firstWorld + K) of the epoch, with
+// common random numbers: all genomes draw the random moves for world k from the same stream, keyed by the epoch.
+template <typename Genome, typename BitWorld>
+void scoreOnWorlds(const Genome* genomes, const int* indices, int count, const BitWorld* worlds, int firstWorld, int K, uint64_t seed, int epochStart, bool trackUsage, Evaluation* results)
+{
+  std::fill(results, results + count, Evaluation {0.0f, 0.0f, RuleUsage()});
+  for (int k = 0; k < K; ++k) {
+    auto world = static_cast<uint32_t>(firstWorld + k);
+    RandomEngine::Key simulateKey {seed, static_cast<uint32_t>(epochStart), 0, RandomEngine::Stream::SIMULATE, world};
+    float maxPoints = worlds[world].canCount * PICK_SUCCESS_PTS;
+    for (int j = 0; j < count; ++j) {
+      BitWorld copy = worlds[world];
+      RandomEngine randomEngine(simulateKey);
+      // Rules consulted on any of the worlds accumulate straight into the result.
+      float points = simulate(genomes[indices != nullptr ? indices[j] : j], copy, randomEngine, trackUsage ? &results[j].usage : nullptr);
+      float score = points > 0 ? points / maxPoints : 0;
+      results[j].score += score / K;
+      results[j].square += score * score;
+    }
+  }
+}
+
+// Wire format between the coordinator and its evaluation workers: a request header followed by `count` raw genomes,
+// answered by a response header followed by `count` Evaluations. Fields are in host byte order and genomes are
+// sent as they are laid out in memory, so both sides must run the same build (checked via genomeBytes and the grid).
+struct BatchRequest
+{
+  static constexpr uint32_t MAGIC = 0x524F4259; // "ROBY"
+  uint32_t magic;
+  uint32_t batch;
+  uint32_t count;
+  uint32_t genomeBytes;
+  uint16_t width;
+  uint16_t height;
+  uint32_t worldCount;
+  uint64_t seed;
+  uint32_t epoch;
+  uint32_t trackUsage;
+  uint64_t corpusWorlds; // 0 for worlds generated from the seed
+  uint32_t epochNumber;  // picks the block of corpus worlds
+  uint32_t reserved;
+};
+
+struct BatchResponse
+{
+  uint32_t magic;
+  uint32_t batch;
+  uint32_t count;
+};
+
+// Blocking stream socket helpers; false means the peer is gone.
+bool sendAll(int fd, const void* data, size_t size)
+{
+  const char* bytes = static_cast<const char*>(data);
+  while (size > 0) {
+    ssize_t sent = send(fd, bytes, size, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    }
+    if (sent <= 0) {
+      return false;
+    }
+    bytes += sent;
+    size -= sent;
+  }
+  return true;
+}
+
+bool receiveAll(int fd, void* data, size_t size)
+{
+  char* bytes = static_cast<char*>(data);
+  while (size > 0) {
+    ssize_t received = recv(fd, bytes, size, 0);
+    if (received < 0 && errno == EINTR) {
+      continue;
+    }
+    if (received <= 0) {
+      return false;
+    }
+    bytes += received;
+    size -= received;
+  }
+  return true;
+}
+
+sockaddr_un socketAddress(const std::string& path)
+{
+  sockaddr_un address {};
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)) {
+    throw std::invalid_argument(fmt::format("socket path too long: {}", path));
+  }
+  std::strcpy(address.sun_path, path.c_str());
+  return address;
+}
+
+// Coordinator side of remote evaluation. Workers may connect at any time; a batch held by a worker which disconnects
+// (or crashes) goes back to the queue and is handed to the next idle one, so results never depend on the workers.
+struct RemoteEvaluator
+{
+  static constexpr int BATCH = 1024;
+
+  RemoteEvaluator(const std::string& path)
+  : path(path)
+  {
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+      throw std::runtime_error(fmt::format("cannot create socket: {}", std::strerror(errno)));
+    }
+    sockaddr_un address = socketAddress(path);
+    unlink(path.c_str());
+    if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(listener, SOMAXCONN) < 0) {
+      throw std::runtime_error(fmt::format("cannot listen on {}: {}", path, std::strerror(errno)));
+    }
+    fcntl(listener, F_SETFL, fcntl(listener, F_GETFL) | O_NONBLOCK);
+  }
+
+  RemoteEvaluator(const RemoteEvaluator&) = delete;
+  RemoteEvaluator& operator=(const RemoteEvaluator&) = delete;
+
+  ~RemoteEvaluator()
+  {
+    for (const Worker& worker : workers) {
+      close(worker.fd);
+    }
+    close(listener);
+    unlink(path.c_str());
+  }
+
+  // Fills results[j] for genomes[indices[j]], j < count; `request` carries everything but batch, count and magic.
+  template <typename Genome>
+  void evaluate(const Genome* genomes, const int* indices, int count, BatchRequest request, Evaluation* results)
+  {
+    request.magic = BatchRequest::MAGIC;
+    request.genomeBytes = sizeof(Genome);
+    const int batches = (count + BATCH - 1) / BATCH;
+    std::vector<int> queue(batches);
+    std::iota(queue.rbegin(), queue.rend(), 0);
+    std::vector<char> buffer;
+    int done = 0;
+    while (done < batches) {
+      acceptWorkers();
+      for (Worker& worker : workers) {
+        if (worker.batch >= 0 || queue.empty()) {
+          continue;
+        }
+        int batch = queue.back();
+        queue.pop_back();
+        request.batch = batch;
+        request.count = std::min(BATCH, count - batch * BATCH);
+        buffer.resize(request.count * sizeof(Genome));
+        for (uint32_t j = 0; j < request.count; ++j) {
+          std::memcpy(&buffer[j * sizeof(Genome)], &genomes[indices[batch * BATCH + j]], sizeof(Genome));
+        }
+        worker.batch = batch;
+        if (!sendAll(worker.fd, &request, sizeof(request)) || !sendAll(worker.fd, buffer.data(), buffer.size())) {
+          drop(worker, queue);
+        }
+      }
+      removeDropped();
+
+      std::vector<pollfd> watched {{listener, POLLIN, 0}};
+      for (const Worker& worker : workers) {
+        watched.push_back({worker.fd, static_cast<short>(worker.batch >= 0 ? POLLIN : 0), 0});
+      }
+      if (workers.empty()) {
+        fmt::print(stderr, "waiting for workers on {}\n", path);
+      }
+      if (poll(watched.data(), watched.size(), -1) < 0 && errno != EINTR) {
+        throw std::runtime_error(fmt::format("poll failed: {}", std::strerror(errno)));
+      }
+      for (size_t w = 0; w < workers.size(); ++w) {
+        Worker& worker = workers[w];
+        if (watched[w + 1].revents == 0) {
+          continue;
+        }
+        BatchResponse response {};
+        int begin = worker.batch * BATCH;
+        bool ok = worker.batch >= 0
+               && receiveAll(worker.fd, &response, sizeof(response))
+               && response.magic == BatchRequest::MAGIC
+               && response.batch == static_cast<uint32_t>(worker.batch)
+               && response.count == static_cast<uint32_t>(std::min(BATCH, count - begin))
+               && receiveAll(worker.fd, &results[begin], response.count * sizeof(Evaluation));
+        if (!ok) {
+          drop(worker, queue);
+          continue;
+        }
+        worker.batch = -1;
+        done += 1;
+      }
+      removeDropped();
+    }
+  }
+
+private:
+  struct Worker {
+    int fd;
+    int batch = -1; // in flight, -1 when idle
+  };
+  std::string path;
+  int listener;
+  std::vector<Worker> workers;
+
+  void acceptWorkers()
+  {
+    for (int fd = accept(listener, nullptr, nullptr); fd >= 0; fd = accept(listener, nullptr, nullptr)) {
+      workers.push_back({fd});
+      fmt::print(stderr, "worker joined, {} connected\n", workers.size());
+    }
+  }
+
+  void drop(Worker& worker, std::vector<int>& queue)
+  {
+    if (worker.batch >= 0) {
+      queue.push_back(worker.batch);
+    }
+    close(worker.fd);
+    worker.fd = -1;
+  }
+
+  void removeDropped()
+  {
+    size_t before = workers.size();
+    workers.erase(std::remove_if(workers.begin(), workers.end(), [](const Worker& w) { return w.fd < 0; }), workers.end());
+    if (workers.size() != before) {
+      fmt::print(stderr, "worker lost, {} connected\n", workers.size());
+    }
+  }
+};
+
+// Worker side: connects to the coordinator, scores every batch it receives and sends the results back. It reconnects
+// when the coordinator goes away, so workers can be started before, during and after a run.
+template <typename Genome, typename BitWorld>
+void serveEvaluations(const Options& options)
+{
+  constexpr int evaluationChunk = 256;
+  ThreadPool pool(options.threads);
+  std::vector<BitWorld> worlds;
+  uint64_t worldSeed = 0;
+  int64_t worldEpoch = -1;
+  std::vector<std::aligned_storage_t<sizeof(Genome), alignof(Genome)>> genomeBytes; // genomes arrive as raw bytes
+  std::vector<Evaluation> results;
+  std::unique_ptr<WorldCorpus<BitWorld>> corpus;
+  if (!options.corpus.empty()) {
+    corpus = std::make_unique<WorldCorpus<BitWorld>>(options.corpus);
+  }
+  sockaddr_un address = socketAddress(options.connect);
+  while (true) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+      throw std::runtime_error(fmt::format("cannot create socket: {}", std::strerror(errno)));
+    }
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+      close(fd);
+      std::this_thread::sleep_for(std::chrono::seconds(1));
+      continue;
+    }
+    fmt::print(stderr, "connected to {}\n", options.connect);
+    BatchRequest request {};
+    while (receiveAll(fd, &request, sizeof(request))) {
+      // Reconnecting would only be dropped again, so a worker which does not match its coordinator gives up.
+      if (request.magic != BatchRequest::MAGIC || request.genomeBytes != sizeof(Genome)
+          || request.width != BitWorld::WIDTH || request.height != BitWorld::HEIGHT) {
+        close(fd);
+        throw std::runtime_error("coordinator runs a different genome format or world size");
+      }
+      if (request.corpusWorlds != static_cast<uint64_t>(corpus ? corpus->size() : 0)) {
+        close(fd);
+        throw std::runtime_error("coordinator uses a different world corpus");
+      }
+      genomeBytes.resize(request.count);
+      results.resize(request.count);
+      if (!receiveAll(fd, genomeBytes.data(), request.count * sizeof(Genome))) {
+        break;
+      }
+      const Genome* genomes = reinterpret_cast<const Genome*>(genomeBytes.data());
+      if (request.seed != worldSeed || request.epoch != worldEpoch || request.worldCount != worlds.size()) {
+        worlds.resize(request.worldCount);
+        makeWorlds(request.seed, request.epoch, request.epochNumber, worlds, corpus.get());
+        worldSeed = request.seed;
+        worldEpoch = request.epoch;
+      }
+      pool.parallelFor(request.count, evaluationChunk, [&](int begin, int end, int) {
+        scoreOnWorlds(&genomes[begin], nullptr, end - begin, worlds.data(), 0, worlds.size(), request.seed, request.epoch, request.trackUsage != 0, &results[begin]);
+      });
+      BatchResponse response {BatchRequest::MAGIC, request.batch, request.count};
+      if (!sendAll(fd, &response, sizeof(response)) || !sendAll(fd, results.data(), results.size() * sizeof(Evaluation))) {
+        break;
+      }
+    }
+    close(fd);
+    fmt::print(stderr, "disconnected from {}\n", options.connect);
+  }
+}
+
+// With a migration ring, this is one island of several: it exchanges its best robots with the neighbouring islands
+// every options.migrationInterval generations and tags its output lines with its index.
+template <typename Genome, typename BitWorld>
+void evolve(const Options& options, MigrationRing<Genome>* ring = nullptr, int island = 0)
+{
+  constexpr int N = POPULATION_SIZE;
+  const Crossover crossover {options.crossover, options.crossoverPoints, options.crossoverParents};
+  const Mutation mutation(1, options.mutationRate);
+  constexpr int evaluationChunk = 256;
+  // The run seed fully determines the results, regardless of the number of threads.
+  const uint64_t seed = options.seed;
+  PopulationArena<Genome> population(N, options.hugePages);
+  const int K = options.worlds;
+  std::vector<float> scores(N, 1.0f / static_cast<float>(N));
+  std::vector<BitWorld> worlds(K);
+  // Fitness reuse: scores and rule usage of the previous generation, the parents of each child,
+  // and the children which still have to be simulated.
+  std::vector<float> previousScores(N);
+  std::vector<RuleUsage> usage(N);
+  std::vector<RuleUsage> previousUsage(N);
+  std::vector<std::pair<int, int>> parents(N);
+  std::vector<char> inherited(N);
+  std::vector<int> pending(N);
+  // Fitness cache: duplicates are simulated once per generation (by their leader) and scores accumulate across
+  // generations; a genome with at least options.cacheSamples world samples is not simulated again.
+  std::unique_ptr<FitnessCache> cache;
+  if (options.cacheSamples > 0) {
+    cache = std::make_unique<FitnessCache>(options.cacheLog2Slots);
+  }
+  std::vector<GenomeHash> hashes(N);
+  std::vector<int> leaderOf(N);
+  ThreadPool pool(options.threads);
+
+  // Generate initial population
+  for (int i = 0; i < N; ++i) {
+    RandomEngine randomEngine({seed, 0, static_cast<uint32_t>(i), RandomEngine::Stream::INITIAL});
+    new (&population.current()[i]) Genome(typename Genome::RandomArgs{}, randomEngine);
+  }
+
+  // Worlds of the next epoch are generated in the background while the current generations are being scored.
+  std::unique_ptr<WorldCorpus<BitWorld>> corpus;
+  if (!options.corpus.empty()) {
+    corpus = std::make_unique<WorldCorpus<BitWorld>>(options.corpus);
+  }
+  WorldPrefetcher<BitWorld> prefetcher(seed, K, corpus.get());
+  prefetcher.request(0, 0);
+  // Remote evaluation: the pending robots of a generation are scored by worker processes.
+  std::unique_ptr<RemoteEvaluator> remote;
+  std::vector<Evaluation> remoteResults;
+  if (!options.listen.empty()) {
+    remote = std::make_unique<RemoteEvaluator>(options.listen);
+    remoteResults.resize(N);
+  }
+  // Racing: pending robots are scored on options.raceWorlds worlds first, and the survivors of every round on twice
+  // as many further worlds. Each round drops the bottom half, except robots whose upper confidence bound
+  // (options.raceConfidence standard errors above the mean) still reaches the mean at the cut. A robot's score is
+  // its mean over the worlds it got.
+  const bool racing = options.raceWorlds > 0 && options.raceWorlds < K;
+  if (racing && remote) {
+    throw std::invalid_argument("racing needs local evaluation");
+  }
+  std::vector<float> raceSum(N);
+  // Worlds and sum of squared scores behind scores[i], for merging into the cache.
+  std::vector<float> sampleSquare(N);
+  std::vector<int> sampleCount(N);
+  // In-generation deduplication and racing need the whole generation, so they always run behind a barrier.
+  const bool pipelined = options.pipeline && !cache && !remote && !racing;
+
+  // Migration: the best robots are sent to the next island, the immigrants replace the worst ones.
+  std::vector<int> ranking(ring ? N : 0);
+  if (ring) {
+    assert(2 * ring->migrantCount() <= N);
+  }
+  else {
+    fmt::print(stderr, "seed={}\n", seed);
+    fmt::print("generation,score\n");
+  }
+  for (int gen = 0; gen < 1e6; ++gen) {
+    // Common random numbers: the whole generation is scored on the same K worlds and random streams, each robot
+    // on its own copy. They are kept for options.worldEpoch generations, during which a child can inherit
+    // the score of a parent it provably behaves like instead of being simulated again.
+    const int epochStart = gen - gen % options.worldEpoch;
+    if (gen == epochStart) {
+      prefetcher.take(worlds);
+      prefetcher.request(epochStart + options.worldEpoch, epochStart / options.worldEpoch + 1);
+    }
+    const bool reuse = options.reuseFitness && gen != epochStart;
+    // Children are bred into the spare buffer, which becomes the current generation once breeding is done.
+    const Genome* robots = population.next();
+    const Genome* previousRobots = population.current();
+    std::swap(scores, previousScores);
+    std::swap(usage, previousUsage);
+
+    auto lookUp = [&](int begin, int end) {
+      for (int i = begin; i < end; ++i) {
+        inherited[i] = false;
+        leaderOf[i] = i;
+        FitnessCache::Stats cached;
+        if (cache) {
+          hashes[i] = hashGenome(robots[i]);
+        }
+        if (cache && cache->find(hashes[i], cached) && (cached.count >= static_cast<uint32_t>(options.cacheSamples) || cached.epoch == epochStart)) {
+          scores[i] = cached.mean;
+          usage[i] = RuleUsage::all(); // unknown, so never inherit from it
+          inherited[i] = true;
+        }
+        for (int parent : {parents[i].first, parents[i].second}) {
+          if (reuse && !inherited[i] && behavesLike(robots[i], previousRobots[parent], previousUsage[parent])) {
+            scores[i] = previousScores[parent];
+            usage[i] = previousUsage[parent];
+            inherited[i] = true;
+          }
+        }
+      }
+    };
+
+    // Stores the evaluations of robots[indices[0..count)].
+    auto record = [&](const int* indices, const Evaluation* results, int count) {
+      for (int j = 0; j < count; ++j) {
+        int i = indices[j];
+        scores[i] = results[j].score;
+        usage[i] = results[j].usage;
+        sampleSquare[i] = results[j].square;
+        sampleCount[i] = K;
+      }
+    };
+
+    // Merges the samples of robots pending[0..count) into the cache, serially and in the order of pending (which
+    // does not depend on the thread count), so that evictions and thus the results are reproducible.
+    auto remember = [&](int count) {
+      for (int j = 0; j < count; ++j) {
+        int i = pending[j];
+        float m2 = std::max(sampleSquare[i] - sampleCount[i] * scores[i] * scores[i], 0.0f);
+        scores[i] = cache->add(hashes[i], {static_cast<uint32_t>(sampleCount[i]), scores[i], m2, epochStart}).mean;
+      }
+    };
+
+    // Scores robots[indices[0..count)] on all K worlds.
+    auto evaluate = [&](const int* indices, int count) {
+      assert(count <= evaluationChunk);
+      std::array<Evaluation, evaluationChunk> results;
+      scoreOnWorlds(robots, indices, count, worlds.data(), 0, K, seed, epochStart, options.reuseFitness, results.data());
+      record(indices, results.data(), count);
+    };
+
+    // Races pending[0..count), which it reorders.
+    auto race = [&](int count) {
+      for (int j = 0; j < count; ++j) {
+        raceSum[pending[j]] = 0.0f;
+        sampleSquare[pending[j]] = 0.0f;
+        usage[pending[j]] = RuleUsage();
+      }
+      int alive = count;
+      int done = 0;
+      for (int round = options.raceWorlds; alive > 0 && done < K; round *= 2) {
+        const int roundWorlds = std::min(round, K - done);
+        pool.parallelFor(alive, evaluationChunk, [&](int begin, int end, int) {
+          std::array<Evaluation, evaluationChunk> results;
+          scoreOnWorlds(robots, &pending[begin], end - begin, worlds.data(), done, roundWorlds, seed, epochStart, options.reuseFitness, results.data());
+          for (int j = begin; j < end; ++j) {
+            int i = pending[j];
+            raceSum[i] += results[j - begin].score * roundWorlds;
+            sampleSquare[i] += results[j - begin].square;
+            usage[i] |= results[j - begin].usage;
+            sampleCount[i] = done + roundWorlds;
+            scores[i] = raceSum[i] / sampleCount[i];
+          }
+        });
+        done += roundWorlds;
+        if (done == K) {
+          break;
+        }
+        // Spread of a single world's score: pooled over the robots, or between robots while each has only one world.
+        double meanSum = 0.0, squareSum = 0.0, withinSum = 0.0;
+        for (int j = 0; j < alive; ++j) {
+          int i = pending[j];
+          meanSum += scores[i];
+          squareSum += scores[i] * scores[i];
+          withinSum += done > 1 ? (sampleSquare[i] - done * scores[i] * scores[i]) / (done - 1) : 0.0;
+        }
+        double variance = done > 1 ? withinSum / alive : squareSum / alive - (meanSum / alive) * (meanSum / alive);
+        float margin = options.raceConfidence * std::sqrt(std::max(variance, 0.0) / done);
+        std::stable_sort(pending.begin(), pending.begin() + alive, [&](int a, int b) { return scores[a] > scores[b]; });
+        int keep = (alive + 1) / 2;
+        float cut = scores[pending[keep - 1]];
+        while (keep < alive && scores[pending[keep]] >= cut - margin) {
+          keep += 1;
+        }
+        alive = keep;
+      }
+    };
+
+    if (pipelined) {
+      // Every chunk of children is scored by the worker which bred it, right away; the only barrier left
+      // is the one before selection, which needs the final fitness of the whole generation.
+      breedNextGeneration(population, previousScores, crossover, mutation, pool, seed, gen, options.selection, parents.data(), [&](int begin, int end, int) {
+        lookUp(begin, end);
+        int count = 0;
+        for (int i = begin; i < end; ++i) {
+          if (!inherited[i]) {
+            pending[begin + count++] = i;
+          }
+        }
+        evaluate(&pending[begin], count);
+      });
+    }
+    else {
+      breedNextGeneration(population, previousScores, crossover, mutation, pool, seed, gen, options.selection, parents.data());
+      pool.parallelFor(N, evaluationChunk, [&](int begin, int end, int) {
+        lookUp(begin, end);
+      });
+      int pendingCount = 0;
+      for (int i = 0; i < N; ++i) {
+        if (!inherited[i]) {
+          pending[pendingCount++] = i;
+        }
+      }
+      int evaluatedCount = pendingCount;
+      if (cache) {
+        auto byHash = [&](int a, int b) { return hashes[a] == hashes[b] ? a < b : hashes[a] < hashes[b]; };
+        std::sort(pending.begin(), pending.begin() + pendingCount, byHash);
+        evaluatedCount = 0;
+        for (int j = 0; j < pendingCount; ++j) {
+          int i = pending[j];
+          if (evaluatedCount > 0 && hashes[pending[evaluatedCount - 1]] == hashes[i]) {
+            leaderOf[i] = pending[evaluatedCount - 1];
+          }
+          else {
+            pending[evaluatedCount++] = i;
+          }
+        }
+      }
+      if (remote) {
+        BatchRequest request {};
+        request.width = BitWorld::WIDTH;
+        request.height = BitWorld::HEIGHT;
+        request.worldCount = K;
+        request.seed = seed;
+        request.epoch = epochStart;
+        request.epochNumber = epochStart / options.worldEpoch;
+        request.trackUsage = options.reuseFitness;
+        request.corpusWorlds = corpus ? corpus->size() : 0;
+        remote->evaluate(robots, pending.data(), evaluatedCount, request, remoteResults.data());
+        record(pending.data(), remoteResults.data(), evaluatedCount);
+      }
+      else if (racing) {
+        race(evaluatedCount);
+      }
+      else {
+        pool.parallelFor(evaluatedCount, evaluationChunk, [&](int begin, int end, int) {
+          evaluate(&pending[begin], end - begin);
+        });
+      }
+      if (cache) {
+        remember(evaluatedCount);
+      }
+      // Duplicates within the generation copy the result of their leader.
+      for (int i = 0; i < N; ++i) {
+        if (leaderOf[i] != i) {
+          scores[i] = scores[leaderOf[i]];
+          usage[i] = usage[leaderOf[i]];
+        }
+      }
+    }
+    float maxScore = *std::max_element(scores.begin(), scores.end());
+    if (ring) {
+      fmt::print("{},{},{}\n", island, gen, maxScore);
+    }
+    else {
+      fmt::print("{},{}\n", gen, maxScore);
+    }
+
+    if (ring && (gen + 1) % options.migrationInterval == 0) {
+      const int migrants = ring->migrantCount();
+      std::iota(ranking.begin(), ranking.end(), 0);
+      std::stable_sort(ranking.begin(), ranking.end(), [&](int a, int b) { return scores[a] > scores[b]; });
+      ring->send(island, gen, population.current(), scores.data(), ranking.data());
+      ring->receive(island, gen, population.current(), scores.data(), ranking.data() + N - migrants);
+      for (int j = N - migrants; j < N; ++j) {
+        usage[ranking[j]] = RuleUsage::all(); // scored elsewhere, so never inherit from it
+      }
+    }
+  }
+}
+
+// Pre-generated worlds, numbered 0, 1, 2, ... and produced in that order by background threads into a bounded ring.
+// A consumer takes world `id` from slot id % capacity once it is ready, which frees the slot for world id + capacity
+// (the sequence scheme of Vyukov's bounded queue, with positions known up front). Every world must be taken
+// eventually and each consumer must take its worlds in increasing order, or producers wait forever.
+template <typename BitWorld>
+struct WorldBank
+{
+  using Generator = std::function<BitWorld(int64_t id)>;
+
+  WorldBank(int capacity, int producers, Generator generator)
+  : slots(capacity)
+  , generator(std::move(generator))
+  {
+    for (int i = 0; i < capacity; ++i) {
+      slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    for (int i = 0; i < producers; ++i) {
+      threads.emplace_back([this] { produce(); });
+    }
+  }
+
+  WorldBank(const WorldBank&) = delete;
+  WorldBank& operator=(const WorldBank&) = delete;
+
+  ~WorldBank()
+  {
+    stopping.store(true);
+    for (auto&& thread : threads) {
+      thread.join();
+    }
+  }
+
+  void take(int64_t id, BitWorld& world)
+  {
+    Slot& slot = slots[id % slots.size()];
+    while (slot.sequence.load(std::memory_order_acquire) != id + 1) {
+      std::this_thread::yield();
+    }
+    world = slot.world;
+    slot.sequence.store(id + static_cast<int64_t>(slots.size()), std::memory_order_release);
+  }
+
+private:
+  struct Slot {
+    std::atomic<int64_t> sequence; // id when free for the producer of world id, id + 1 once it holds world id
+    BitWorld world;
+  };
+  std::vector<Slot> slots;
+  Generator generator;
+  std::atomic<int64_t> nextId = {0};
+  std::atomic<bool> stopping = {false};
+  std::vector<std::thread> threads;
+
+  void produce()
+  {
+    for (int64_t id = nextId.fetch_add(1); !stopping.load(std::memory_order_relaxed); id = nextId.fetch_add(1)) {
+      BitWorld world = generator(id);
+      Slot& slot = slots[id % slots.size()];
+      while (slot.sequence.load(std::memory_order_acquire) != id) {
+        if (stopping.load(std::memory_order_relaxed)) {
+          return;
+        }
+        std::this_thread::yield();
+      }
+      slot.world = world;
+      slot.sequence.store(id + 1, std::memory_order_release);
+    }
+  }
+};
+
+// Steady-state engine without generation barriers: every worker keeps breeding a batch of children from
+// tournament-selected parents, scores it and overwrites the losers of inverse tournaments. A slot is guarded by
+// its own spinlock, so robots which take the full step budget only delay their own worker. The interleaving of
+// workers depends on timing, so a run is only reproducible from its seed with a single thread.
+template <typename Genome, typename BitWorld>
+void evolveSteadyState(const Options& options)
+{
+  constexpr int N = POPULATION_SIZE;
+  const Crossover crossover {options.crossover, options.crossoverPoints, options.crossoverParents};
+  const Mutation mutation(1, options.mutationRate);
+  constexpr int tournamentSize = 3;
+  constexpr int batchSize = 16; // children bred, scored and placed per round of a worker
+  static_assert(N % batchSize == 0, "a batch must not span two generations");
+  // Births are counted in generations of N children, which also key their random streams.
+  constexpr int64_t maxBirths = int64_t{1000000} * N;
+  const uint64_t seed = options.seed;
+  const int K = options.worlds;
+  struct Slot {
+    std::atomic<bool> locked = {false};
+    std::atomic<float> score = {0.0f};
+  };
+  PopulationArena<Genome> population(N, options.hugePages);
+  Genome* robots = population.current();
+  std::vector<Slot> slots(N);
+  ThreadPool pool(options.threads);
+  // World k of the child born as `birth` is world birth * K + k of the bank, built off the critical path.
+  std::unique_ptr<WorldCorpus<BitWorld>> corpus;
+  if (!options.corpus.empty()) {
+    corpus = std::make_unique<WorldCorpus<BitWorld>>(options.corpus);
+  }
+  WorldBank<BitWorld> bank(std::max(4 * options.threads * batchSize * K, 1024), options.worldProducers, [seed, K, &corpus](int64_t id) {
+    if (corpus) {
+      return (*corpus)[id % corpus->size()];
+    }
+    int64_t birth = id / K;
+    RandomEngine randomEngine({seed, static_cast<uint32_t>(birth / N), static_cast<uint32_t>(birth % N), RandomEngine::Stream::WORLD, static_cast<uint32_t>(id % K)});
+    return BitWorld(BitWorld::FILL, randomEngine);
+  });
+
+  auto lock = [&](int i) { while (slots[i].locked.exchange(true, std::memory_order_acquire)) { } };
+  auto unlock = [&](int i) { slots[i].locked.store(false, std::memory_order_release); };
+  auto copyOf = [&](int i) {
+    lock(i);
+    Genome genome = robots[i];
+    unlock(i);
+    return genome;
+  };
+  // Index of the best (or worst) of tournamentSize uniformly drawn robots.
+  auto tournament = [&](RandomEngine& randomEngine, bool best) {
+    int winner = randomEngine.below(N);
+    for (int t = 1; t < tournamentSize; ++t) {
+      int challenger = randomEngine.below(N);
+      float score = slots[challenger].score.load(std::memory_order_relaxed);
+      float winnerScore = slots[winner].score.load(std::memory_order_relaxed);
+      winner = (best ? score > winnerScore : score < winnerScore) ? challenger : winner;
+    }
+    return winner;
+  };
+  // Scores the children born as [firstBirth, firstBirth + count), each on K fresh worlds of its own.
+  auto evaluate = [&](const Genome* genomes, int64_t firstBirth, int count, float* scores) {
+    auto generation = static_cast<uint32_t>(firstBirth / N);
+    auto individual = static_cast<uint32_t>(firstBirth % N);
+    for (int c = 0; c < count; ++c) {
+      scores[c] = 0.0f;
+      for (int k = 0; k < K; ++k) {
+        BitWorld world;
+        bank.take((firstBirth + c) * K + k, world);
+        float maxPoints = world.canCount * PICK_SUCCESS_PTS;
+        RandomEngine randomEngine({seed, generation, individual + c, RandomEngine::Stream::SIMULATE, static_cast<uint32_t>(k)});
+        float points = simulate(genomes[c], world, randomEngine);
+        scores[c] += (points > 0 ? points / maxPoints : 0) / K;
+      }
+    }
+  };
+
+  // Generate and score the initial population, which counts as the first generation of births.
+  pool.parallelFor(N, batchSize, [&](int begin, int end, int) {
+    std::array<float, batchSize> scores;
+    for (int i = begin; i < end; ++i) {
+      RandomEngine randomEngine({seed, 0, static_cast<uint32_t>(i), RandomEngine::Stream::INITIAL});
+      new (&robots[i]) Genome(typename Genome::RandomArgs{}, randomEngine);
+    }
+    evaluate(&robots[begin], begin, end - begin, scores.data());
+    for (int i = begin; i < end; ++i) {
+      slots[i].score.store(scores[i - begin], std::memory_order_relaxed);
+    }
+  });
+
+  fmt::print(stderr, "seed={}\n", seed);
+  fmt::print("generation,score\n");
+  std::atomic<int64_t> nextBirth = {N};
+  std::mutex printMutex;
+  pool.parallelFor(pool.size(), 1, [&](int, int, int) {
+    std::vector<Genome> children;
+    children.reserve(batchSize);
+    std::vector<Genome> parents; // copies, as the slots may be overwritten meanwhile
+    parents.reserve(Crossover::MAX_PARENTS);
+    const Genome* parentGenomes[Crossover::MAX_PARENTS];
+    Recombination recombination;
+    std::array<float, batchSize> scores;
+    for (int64_t birth = nextBirth.fetch_add(batchSize); birth < maxBirths; birth = nextBirth.fetch_add(batchSize)) {
+      auto generation = static_cast<uint32_t>(birth / N);
+      auto individual = static_cast<uint32_t>(birth % N);
+      children.clear();
+      for (int c = 0; c < batchSize; ++c) {
+        RandomEngine randomEngine({seed, generation, individual + c, RandomEngine::Stream::BREED});
+        parents.clear();
+        for (int p = 0; p < crossover.parentCount(); ++p) {
+          parents.push_back(copyOf(tournament(randomEngine, true)));
+          parentGenomes[p] = &parents[p];
+        }
+        crossover.select(recombination, Genome::LENGTH, randomEngine);
+        children.emplace_back(parentGenomes, crossover.parentCount(), recombination);
+        if (!mutation.perGene()) {
+          children.back().mutate(mutation.geneCount, randomEngine);
+        }
+      }
+      if (mutation.perGene()) {
+        RandomEngine randomEngine({seed, generation, individual, RandomEngine::Stream::MUTATE});
+        mutatePopulation(children.data(), batchSize, mutation, randomEngine);
+      }
+      evaluate(children.data(), birth, batchSize, scores.data());
+      for (int c = 0; c < batchSize; ++c) {
+        RandomEngine randomEngine({seed, generation, individual + c, RandomEngine::Stream::BREED, 1});
+        int victim = tournament(randomEngine, false);
+        lock(victim);
+        robots[victim] = children[c];
+        slots[victim].score.store(scores[c], std::memory_order_relaxed);
+        unlock(victim);
+      }
+      if ((birth + batchSize) % N == 0) {
+        float maxScore = 0.0f;
+        for (const Slot& slot : slots) {
+          maxScore = std::max(maxScore, slot.score.load(std::memory_order_relaxed));
+        }
+        std::lock_guard<std::mutex> guard(printMutex);
+        fmt::print("{},{}\n", generation, maxScore);
+      }
+    }
+  });
+}
+
+// Island model: forks options.islands processes, each evolving its own population from its own seed on its own
+// share of the CPUs this process may run on (consecutive CPUs, which usually means one socket per island when
+// islands match sockets). They only talk to each other through the migration ring.
+template <typename Genome, typename BitWorld>
+void evolveOnIslands(const Options& options)
+{
+  MigrationRing<Genome> ring(options.islands, options.migrants);
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  sched_getaffinity(0, sizeof(allowed), &allowed);
+  std::vector<int> cpus;
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (CPU_ISSET(cpu, &allowed)) {
+      cpus.push_back(cpu);
+    }
+  }
+
+  fmt::print(stderr, "seed={}\n", options.seed);
+  fmt::print("island,generation,score\n");
+  std::fflush(stdout); // or the children inherit (and repeat) whatever is buffered
+  std::vector<pid_t> children;
+  for (int island = 0; island < options.islands; ++island) {
+    pid_t pid = fork();
+    if (pid < 0) {
+      throw std::runtime_error(fmt::format("cannot fork island {}: {}", island, std::strerror(errno)));
+    }
+    if (pid > 0) {
+      children.push_back(pid);
+      continue;
+    }
+    // Island process: lines of different islands must not interleave mid-line.
+    std::setvbuf(stdout, nullptr, _IOLBF, 0);
+    int share = std::max<int>(cpus.size() / options.islands, 1);
+    cpu_set_t own;
+    CPU_ZERO(&own);
+    for (int j = 0; j < share; ++j) {
+      CPU_SET(cpus[(island * share + j) % cpus.size()], &own);
+    }
+    sched_setaffinity(0, sizeof(own), &own);
+    Options islandOptions = options;
+    islandOptions.seed = options.seed + island * 0x9E3779B97F4A7C15;
+    islandOptions.threads = std::max(options.threads / options.islands, 1);
+    try {
+      evolve<Genome, BitWorld>(islandOptions, &ring, island);
+    }
+    catch (const std::exception& e) {
+      fmt::print(stderr, "island {}: {}\n", island, e.what());
+      std::_Exit(EXIT_FAILURE);
+    }
+    std::fflush(stdout);
+    std::_Exit(EXIT_SUCCESS);
+  }
+
+  // The others would wait forever for migrants from an island which died, so one failure stops them all.
+  bool failed = false;
+  for (size_t remaining = children.size(); remaining > 0; --remaining) {
+    int status = 0;
+    pid_t pid = wait(&status);
+    if (pid < 0) {
+      break;
+    }
+    if (!failed && !(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS)) {
+      failed = true;
+      for (pid_t child : children) {
+        kill(child, SIGTERM);
+      }
+    }
+  }
+  if (failed) {
+    throw std::runtime_error("an island failed");
+  }
+}
+
+// Name of the first option which differs from its default and only affects the generational engine, or nullptr.
+const char* generationalOption(const Options& options)
+{
+  const Options defaults;
+  if (options.selection != defaults.selection) return "selection";
+  if (options.reuseFitness != defaults.reuseFitness) return "reuse-fitness";
+  if (options.cacheSamples != defaults.cacheSamples) return "cache-samples";
+  if (options.raceWorlds != defaults.raceWorlds) return "race-worlds";
+  if (options.worldEpoch != defaults.worldEpoch) return "world-epoch";
+  if (options.pipeline != defaults.pipeline) return "pipeline";
+  return nullptr;
+}
+
+template <typename Genome, typename BitWorld>
+void evolveWithEngine(const Options& options)
+{
+  if (!options.connect.empty()) {
+    return serveEvaluations<Genome, BitWorld>(options);
+  }
+  if (!options.listen.empty() && (options.engine != Engine::GENERATIONAL || options.islands > 1)) {
+    throw std::invalid_argument("remote evaluation needs the generational engine on a single island");
+  }
+  switch (options.engine) {
+    case Engine::GENERATIONAL:
+      if (options.islands > 1) {
+        evolveOnIslands<Genome, BitWorld>(options);
+      }
+      else {
+        evolve<Genome, BitWorld>(options);
+      }
+      break;
+    case Engine::STEADY_STATE:
+      if (options.islands > 1) {
+        throw std::invalid_argument("islands need the generational engine");
+      }
+      // Options which only make sense with generations are rejected rather than silently ignored.
+      if (const char* option = generationalOption(options)) {
+        throw std::invalid_argument(fmt::format("--{} needs the generational engine", option));
+      }
+      evolveSteadyState<Genome, BitWorld>(options);
+      break;
+  }
+}
+
+template <typename BitWorld>
+void evolveOnGrid(const Options& options)
+{
+  if (!options.writeCorpus.empty()) {
+    fmt::print(stderr, "seed={}\n", options.seed);
+    return WorldCorpus<BitWorld>::write(options.writeCorpus, options.corpusWorlds, options.seed);
+  }
+  switch (options.genome) {
+    case GenomeFormat::BYTES:
+      evolveWithEngine<RobotGenome, BitWorld>(options);
+      break;
+    case GenomeFormat::PACKED:
+      evolveWithEngine<PackedGenome, BitWorld>(options);
+      break;
+    case GenomeFormat::COMPACT:
+      evolveWithEngine<BasicCompactGenome<BitWorld>, BitWorld>(options);
+      break;
+  }
+}
+
+// Grid sizes with a compiled simulator; the step budget is width * height as before.
+void evolve(const Options& options)
+{
+  auto size = std::make_pair(options.width, options.height);
+  if (size == std::make_pair(10, 10)) {
+    return evolveOnGrid<BasicBitWorld<10, 10>>(options);
+  }
+  if (size == std::make_pair(11, 11)) {
+    return evolveOnGrid<BasicBitWorld<11, 11>>(options);
+  }
+  if (size == std::make_pair(16, 16)) {
+    return evolveOnGrid<BasicBitWorld<16, 16>>(options);
+  }
+  if (size == std::make_pair(32, 32)) {
+    return evolveOnGrid<BasicBitWorld<32, 32>>(options);
+  }
+  throw std::invalid_argument(fmt::format("unsupported world size {}x{}, use 10x10, 11x11, 16x16 or 32x32", options.width, options.height));
+}
+
+int main(int argc, char** argv)
+{
+  try {
+    const Options options = Options::parse(argc, argv);
+    evolve(options);
+  }
+  catch (const std::exception& e) {
+    fmt::print(stderr, "error: {}\n{}", e.what(), Options::USAGE);
+    return 1;
   }
 }